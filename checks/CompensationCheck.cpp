@@ -0,0 +1,64 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Adds a billion photons to a single pixel, as a long render does, and
+// checks that the compensated sum of the gather unit stays close to the
+// exact total where a plain float sum stalls (make check).
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include "../src/GatherUnit.h"
+
+using namespace Luculentus;
+
+int main()
+{
+  // Photons do not all carry the same energy, cycle through a few
+  const float energies[] = { 0.013f, 0.027f, 0.0041f, 0.052f,
+                             0.0093f, 0.031f, 0.0007f, 0.019f };
+  const int numberOfEnergies = sizeof(energies) / sizeof(energies[0]);
+  const std::int64_t numberOfPhotons = 1000000000;
+
+  float sum = 0.0f, compensation = 0.0f, plainSum = 0.0f;
+  for (std::int64_t i = 0; i < numberOfPhotons; i++)
+  {
+    const float energy = energies[i % numberOfEnergies];
+    CompensatedAdd(sum, compensation, energy);
+    plainSum += energy;
+  }
+
+  // Every energy occurs equally often, so the exact total is known
+  double exact = 0.0;
+  for (int k = 0; k < numberOfEnergies; k++)
+    exact += static_cast<double>(energies[k]);
+  exact *= static_cast<double>(numberOfPhotons / numberOfEnergies);
+
+  const double error = std::abs(sum - exact) / exact;
+  const double plainError = std::abs(plainSum - exact) / exact;
+  std::cout << "exact " << exact << ", compensated " << sum
+            << " (relative error " << error << "), plain " << plainSum
+            << " (relative error " << plainError << ")" << std::endl;
+
+  if (error > 1.0e-6)
+  {
+    std::cerr << "the compensated sum drifted from the exact total"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
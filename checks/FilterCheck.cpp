@@ -0,0 +1,123 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Plots photons with every reconstruction filter, one at a time near
+// the edges of the canvas and many at once into a shared film, and
+// checks that the weights of every photon sum to one, so filtering
+// moves light around but never adds or removes any (make check).
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../src/Cie1931.h"
+#include "../src/PlotUnit.h"
+#include "../src/ReconstructionFilter.h"
+#include "../src/SharedFilm.h"
+
+using namespace Luculentus;
+
+/// Returns the sum of all tristimulus values of the canvas.
+static double GetTotal(const std::vector<Vector3>& canvas)
+{
+  double total = 0.0;
+  for (auto& cie : canvas) total += cie.x + cie.y + cie.z;
+  return total;
+}
+
+/// Returns the sum of the tristimulus values of the photon.
+static double GetTotal(const MappedPhoton& photon)
+{
+  const Vector3 cie = Cie1931::GetTristimulus(photon.wavelength)
+                    * photon.probability;
+  return cie.x + cie.y + cie.z;
+}
+
+int main()
+{
+  const int width = 96, height = 64;
+  const float aspectRatio = static_cast<float>(width) / height;
+  const Settings::Filter filters[] = { Settings::Gaussian,
+                                       Settings::Mitchell,
+                                       Settings::BlackmanHarris };
+  const char* names[] = { "gaussian", "mitchell", "blackman-harris" };
+  const float maximumRadius = ReconstructionFilter::maximumRadius;
+  const float radii[] = { 1.0f, 2.0f, 3.5f, maximumRadius };
+
+  // Photons land anywhere on the screen, and a little beyond its edges
+  std::minstd_rand engine(7);
+  std::uniform_real_distribution<float> position(-1.05f, 1.05f);
+  std::uniform_real_distribution<float> wavelength(380.0f, 780.0f);
+  auto makePhoton = [&]()
+  {
+    MappedPhoton photon;
+    photon.x = position(engine);
+    photon.y = position(engine) / aspectRatio;
+    photon.wavelength = wavelength(engine);
+    photon.probability = 1.0f;
+    return photon;
+  };
+
+  bool passed = true;
+  for (int f = 0; f < 3; f++)
+  {
+    for (auto radius : radii)
+    {
+      const ReconstructionFilter filter(filters[f], radius);
+
+      // One photon at a time, with a canvas of the plot unit's own
+      double worstPhoton = 0.0;
+      PlotUnit plotUnit(width, height, nullptr, &filter, 0);
+      for (int i = 0; i < 2000; i++)
+      {
+        const std::vector<MappedPhoton> photons(1, makePhoton());
+        plotUnit.Plot(photons);
+        const double expected = GetTotal(photons[0]);
+        worstPhoton = std::max(worstPhoton,
+          std::abs(GetTotal(plotUnit.tristimulusBuffer) - expected)
+          / expected);
+        plotUnit.Clear();
+      }
+
+      // Many photons at once into a shared film, which sorts them into
+      // bins and plots crowded bins through a scratch tile
+      SharedFilm film(width, height);
+      PlotUnit filmUnit(width, height, &film, &filter, 0);
+      std::vector<MappedPhoton> photons(100000);
+      double expected = 0.0;
+      for (auto& photon : photons)
+      {
+        photon = makePhoton();
+        expected += GetTotal(photon);
+      }
+      filmUnit.Plot(photons);
+      const double batchError =
+        std::abs(GetTotal(film.tristimulusBuffer) - expected) / expected;
+
+      std::cout << names[f] << " with radius " << radius
+                << ": relative error at most " << worstPhoton
+                << " per photon, " << batchError << " per batch"
+                << std::endl;
+      if (worstPhoton > 1.0e-5 || batchError > 1.0e-4) passed = false;
+    }
+  }
+
+  if (!passed)
+    std::cerr << "the filter weights do not sum to one" << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Saves the spectra of a gather unit to a file and loads them into
+// another one, and checks that the values survive the round trip up to
+// the precision of half floats, and that films which do not fit the
+// canvas are rejected (make check).
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/GatherUnit.h"
+#include "../src/Settings.h"
+
+using namespace Luculentus;
+
+int main(int argc, char** argv)
+{
+  const std::string fileName = argc > 1 ? argv[1] : "spectra.bin";
+  const int width = 48, height = 32, bands = 16;
+
+  // Values that span a few orders of magnitude, some pixels without
+  // light, and a maximum far outside the range of half floats
+  GatherUnit saved(width, height, bands, false);
+  std::minstd_rand engine(11);
+  std::uniform_real_distribution<float> exponent(0.0f, 6.0f);
+  const float maximum = 3.0e6f;
+  for (auto& value : saved.spectralBuffer)
+    value = maximum * std::exp(-exponent(engine));
+  for (int i = 0; i < bands * 40; i++) saved.spectralBuffer[i] = 0.0f;
+  saved.spectralBuffer[bands * 40] = maximum;
+
+  bool passed = saved.SaveSpectra(fileName);
+
+  GatherUnit loaded(width, height, 4, true);
+  passed = passed && loaded.LoadSpectra(fileName);
+  passed = passed && loaded.numberOfBands == bands
+         && loaded.spectralBuffer.size() == saved.spectralBuffer.size();
+
+  // Rounding to a half float with an 11-bit significand
+  double worstError = 0.0;
+  for (size_t i = 0; passed && i < saved.spectralBuffer.size(); i++)
+  {
+    const float original = saved.spectralBuffer[i];
+    const float error = std::abs(loaded.spectralBuffer[i] - original);
+    if (original == 0.0f) worstError = std::max(worstError,
+                                                static_cast<double>(error));
+    else worstError = std::max(worstError,
+                               static_cast<double>(error / original));
+  }
+  std::cout << "relative error at most " << worstError
+            << " after a round trip" << std::endl;
+  if (worstError > std::ldexp(1.0, -11)) passed = false;
+
+  // A film of another size does not fit the canvas
+  GatherUnit smaller(width / 2, height, bands, false);
+  if (smaller.LoadSpectra(fileName))
+  {
+    std::cerr << "a film of another size was loaded" << std::endl;
+    passed = false;
+  }
+
+  // Nor does a film with more bands than can be tonemapped
+  {
+    std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+    file << "Luculentus spectra\n" << width << " " << height << " "
+         << Settings::maximumSpectralBands + 1 << "\n1\n";
+    const std::vector<char> halves(width * height
+      * (Settings::maximumSpectralBands + 1) * 2, 0);
+    file.write(&halves[0], halves.size());
+  }
+  if (loaded.LoadSpectra(fileName))
+  {
+    std::cerr << "a film with too many bands was loaded" << std::endl;
+    passed = false;
+  }
+
+  if (!passed)
+    std::cerr << "the spectra do not survive a round trip" << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Tonemaps a synthetic image that spans six orders of magnitude, and
+// compares the result with the same image tonemapped with the precise
+// math functions. Build it once with LUCULENTUS_PRECISE_MATH to write
+// the reference, and once without to compare (make check).
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/GatherUnit.h"
+#include "../src/Settings.h"
+#include "../src/TonemapUnit.h"
+
+using namespace Luculentus;
+
+int main(int argc, char** argv)
+{
+  if (argc != 3 || (std::string(argv[1]) != "--write"
+                    && std::string(argv[1]) != "--compare"))
+  {
+    std::cerr << "usage: " << argv[0] << " --write|--compare file.ppm"
+              << std::endl;
+    return 2;
+  }
+
+  // Brightness increases from left to right, and the colour changes
+  // from top to bottom
+  const int width = 256, height = 128;
+  GatherUnit gatherUnit(width, height, 0, false);
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      const float intensity = std::pow(10.0f, x * 6.0f / width - 3.0f);
+      const float hue = y * 6.283f / height;
+      const Vector3 cie =
+      {
+        intensity * (1.0f + 0.5f * std::cos(hue)),
+        intensity,
+        intensity * (1.0f + 0.5f * std::sin(hue))
+      };
+      gatherUnit.tristimulusBuffer[y * width + x] = cie;
+    }
+  }
+
+  Settings settings;
+  TonemapUnit tonemapUnit(width, height, settings);
+  tonemapUnit.Tonemap(gatherUnit);
+
+  if (std::string(argv[1]) == "--write")
+    return tonemapUnit.Save(argv[2]) ? 0 : 1;
+
+  // Skip the PPM header, the rest is the raw buffer
+  std::ifstream file(argv[2], std::ios::in | std::ios::binary);
+  std::string magic;
+  int fileWidth, fileHeight, maximum;
+  file >> magic >> fileWidth >> fileHeight >> maximum;
+  file.get();
+  std::vector<char> reference(width * height * 3);
+  file.read(&reference[0], reference.size());
+  if (!file.good() || fileWidth != width || fileHeight != height)
+  {
+    std::cerr << "could not read " << argv[2] << std::endl;
+    return 1;
+  }
+
+  // The approximations may round a channel to the neighbouring level,
+  // but no further
+  int largestDifference = 0;
+  int differences = 0;
+  for (size_t i = 0; i < reference.size(); i++)
+  {
+    const int difference = std::abs(
+      static_cast<int>(static_cast<unsigned char>(reference[i]))
+      - static_cast<int>(tonemapUnit.rgbBuffer[i]));
+    if (difference > largestDifference) largestDifference = difference;
+    if (difference > 0) differences++;
+  }
+
+  std::cout << differences << " of " << reference.size()
+            << " channels differ from the precise image, by at most "
+            << largestDifference << std::endl;
+  return largestDifference <= 1 ? 0 : 1;
+}
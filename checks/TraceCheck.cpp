@@ -0,0 +1,180 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Traces a batch of paths with a fixed seed through a small scene with
+// the materials and the lens that use the fast math functions, and
+// compares the image with the same batch traced with the precise math
+// functions. Build it once with LUCULENTUS_PRECISE_MATH to write the
+// reference, and once without to compare (make check).
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../src/Constants.h"
+#include "../src/EmissiveMaterial.h"
+#include "../src/GatherUnit.h"
+#include "../src/GuidingField.h"
+#include "../src/Material.h"
+#include "../src/PlotUnit.h"
+#include "../src/Scene.h"
+#include "../src/ScreenDistribution.h"
+#include "../src/Settings.h"
+#include "../src/Surface.h"
+#include "../src/TraceUnit.h"
+
+using namespace Luculentus;
+
+/// A light above a diffuse floor, with spheres of soap, iridescent
+/// material and glass, seen through a lens with depth of field.
+static Scene BuildCheckScene()
+{
+  Scene scene;
+
+  const Vector3 up = { 0.0f, 0.0f, 1.0f };
+  const Vector3 floorPosition = { 0.0f, 0.0f, 0.0f };
+  const Vector3 lightPosition = { 0.0f, 0.0f, 12.0f };
+  Object floor = { std::make_shared<Plane>(up, floorPosition),
+                   std::make_shared<DiffuseGreyMaterial>(0.8f), nullptr };
+  Object light = { std::make_shared<Circle>(-up, lightPosition, 40.0f),
+                   nullptr,
+                   std::make_shared<BlackBodyMaterial>(6504.0f, 1.0f) };
+  scene.objects.push_back(floor);
+  scene.objects.push_back(light);
+
+  const Vector3 positions[] =
+  {
+    { -4.5f, 0.0f, 2.2f }, { 0.0f, 0.0f, 2.2f }, { 4.5f, 0.0f, 2.2f }
+  };
+  const std::shared_ptr<Material> materials[] =
+  {
+    std::make_shared<SoapBubbleMaterial>(),
+    std::make_shared<IridescentMaterial>(),
+    std::make_shared<Sf10GlassMaterial>()
+  };
+  for (int i = 0; i < 3; i++)
+  {
+    Object sphere = { std::make_shared<Sphere>(positions[i], 2.2f),
+                      materials[i], nullptr };
+    scene.objects.push_back(sphere);
+  }
+
+  scene.GetCameraAtTime = [](const float) -> Camera
+  {
+    Camera camera;
+    camera.position = MakeVector3(0.0f, -10.0f, 4.0f);
+    camera.fieldOfView = static_cast<float>(pi * 0.35f);
+    camera.orientation = Rotation(1.0f, 0.0f, 0.0f,
+                                  -static_cast<float>(pi) * 0.04f);
+    camera.focalDistance = 10.0f;
+    camera.depthOfField = 2.0f;
+    camera.chromaticAberration = 0.012f;
+    return camera;
+  };
+
+  scene.Compile();
+  return scene;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3 || (std::string(argv[1]) != "--write"
+                    && std::string(argv[1]) != "--compare"))
+  {
+    std::cerr << "usage: " << argv[0] << " --write|--compare file.txt"
+              << std::endl;
+    return 2;
+  }
+
+  const int width = 128, height = 96;
+  const int numberOfPaths = 1000000;
+  const Scene scene = BuildCheckScene();
+
+  Settings settings;
+  TraceUnit traceUnit(scene, 42, width, height, numberOfPaths, settings,
+                      nullptr, nullptr);
+  PlotUnit plotUnit(width, height, nullptr, nullptr, 0);
+  GatherUnit gatherUnit(width, height, 0, false);
+  traceUnit.Render(numberOfPaths, ScreenDistribution(width, height),
+                   GuidingDistribution(), nullptr);
+  plotUnit.Plot(traceUnit);
+  gatherUnit.Accumulate(plotUnit, 0, 1);
+
+  // Paths that take a different turn because of a rounding difference
+  // end up elsewhere, so compare the tristimulus values of blocks of
+  // pixels. The materials mostly change the colour, so all three count.
+  const int blockSize = 32;
+  const int blocksX = width / blockSize, blocksY = height / blockSize;
+  std::vector<double> blocks(blocksX * blocksY * 3, 0.0);
+  double total = 0.0;
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      const Vector3 cie = gatherUnit.tristimulusBuffer[y * width + x];
+      double* block =
+        &blocks[((y / blockSize) * blocksX + x / blockSize) * 3];
+      block[0] += cie.x;
+      block[1] += cie.y;
+      block[2] += cie.z;
+      total += cie.x + cie.y + cie.z;
+    }
+  }
+
+  if (std::string(argv[1]) == "--write")
+  {
+    std::ofstream file(argv[2]);
+    file.precision(17);
+    for (auto block : blocks) file << block << "\n";
+    return file.good() ? 0 : 1;
+  }
+
+  std::ifstream file(argv[2]);
+  std::vector<double> reference(blocks.size());
+  double referenceTotal = 0.0;
+  for (auto& block : reference)
+  {
+    file >> block;
+    referenceTotal += block;
+  }
+  if (!file.good())
+  {
+    std::cerr << "could not read the reference " << argv[2] << std::endl;
+    return 1;
+  }
+
+  // Differences are relative to the average block, so that dark blocks
+  // do not dominate
+  const double averageBlock = referenceTotal / blocks.size();
+  double worstBlock = 0.0;
+  for (size_t i = 0; i < blocks.size(); i++)
+    worstBlock = std::max(worstBlock,
+                          std::abs(blocks[i] - reference[i]) / averageBlock);
+  const double totalError = std::abs(total - referenceTotal)
+                          / referenceTotal;
+
+  std::cout << "the traced image differs from the precise one by "
+            << totalError << " in total, and by at most " << worstBlock
+            << " of the average block" << std::endl;
+
+  // Fast math changes the image by about half of these bounds, a bias
+  // of 2% in the arc cosine of the materials by more than them
+  return totalError < 0.001 && worstBlock < 0.008 ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <atomic>
+
+namespace Luculentus
+{
+  /// Adds the value to the sum. There is no atomic addition for floats,
+  /// but a compare-and-swap loop rarely has to retry, because threads
+  /// seldom add to the same sum at the same time.
+  inline void AtomicAdd(std::atomic<float>& sum, const float value)
+  {
+    float old = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(old, old + value,
+                                      std::memory_order_relaxed)) { }
+  }
+}
@@ -0,0 +1,427 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "BidirectionalTracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include "Constants.h"
+#include "MonteCarloUnit.h"
+#include "Scene.h"
+#include "ScreenDistribution.h"
+#include "TraceUnit.h"
+
+using namespace Luculentus;
+
+/// The power heuristic, with exponent 2.
+static inline float Mis(const float x)
+{
+  return x * x;
+}
+
+BidirectionalTracer::BidirectionalTracer(const Scene& scn,
+                                         const float aspect)
+  : scene(scn)
+  , aspectRatio(aspect)
+{
+
+}
+
+float BidirectionalTracer::Render(const float x, const float y,
+                                 const float wavelength,
+                                 const float screenWeight,
+                                 const ScreenDistribution& screenDistribution,
+                                 MonteCarloUnit& monteCarloUnit,
+                                 std::vector<MappedPhoton>& mappedPhotons)
+{
+  // Both subpaths see the scene at the same time
+  const Camera camera = scene.GetCamera(monteCarloUnit.GetUnit());
+  const float totalPower = scene.GetTotalPower(wavelength);
+
+  // First trace the light subpath, so the camera subpath can be
+  // connected to all of its vertices
+  lightVertices.clear();
+  TraceLightSubpath(camera, wavelength, totalPower, screenDistribution,
+                    monteCarloUnit, mappedPhotons);
+
+  return TraceCameraSubpath(camera, x, y, wavelength, screenWeight,
+                            totalPower, monteCarloUnit);
+}
+
+void BidirectionalTracer::TraceLightSubpath(const Camera& camera,
+  const float wavelength, const float totalPower,
+  const ScreenDistribution& screenDistribution,
+  MonteCarloUnit& monteCarloUnit, std::vector<MappedPhoton>& mappedPhotons)
+{
+  LightSample light;
+  if (!scene.SampleLight(wavelength, totalPower, monteCarloUnit, light))
+    return;
+
+  // Emit the photon in a cosine-weighted direction
+  SubpathState state;
+  state.origin = light.position;
+  state.direction = RotateTowards(
+    monteCarloUnit.GetCosineDistributedHemisphereVector(), light.normal);
+
+  const float cosTheta = Dot(state.direction, light.normal);
+  const float emissionProbability = light.probability * cosTheta
+                                  / static_cast<float>(pi);
+  if (emissionProbability <= 0.0f) return;
+
+  state.throughput = light.intensity * cosTheta / emissionProbability;
+  if (state.throughput <= 0.0f) return;
+  state.survivalScale = 1.0f / state.throughput;
+  state.dVCM = Mis(light.probability / emissionProbability);
+  state.dVC = Mis(cosTheta / emissionProbability);
+
+  for (int depth = 0; ; depth++)
+  {
+    Ray ray;
+    ray.origin = state.origin + state.direction * 0.00001f;
+    ray.direction = state.direction;
+    ray.wavelength = wavelength;
+
+    Intersection intersection;
+    const Object* object = scene.Intersect(ray, intersection);
+
+    // Light that leaves the scene, or that hits a light source,
+    // does not reach the camera any more
+    if (!object || !object->material) return;
+
+    // Account for the geometry term of the segment
+    const float cosIn = std::abs(Dot(state.direction, intersection.normal));
+    if (cosIn <= 0.0f) return;
+    const float distanceSquared = intersection.distance
+                                * intersection.distance;
+    state.dVCM *= Mis(distanceSquared);
+    state.dVCM /= Mis(cosIn);
+    state.dVC /= Mis(cosIn);
+
+    // Diffuse vertices can be connected to; store them for the camera
+    // subpath, and try to connect them to the camera directly
+    if (object->material->IsDiffuse())
+    {
+      PathVertex vertex;
+      vertex.position = intersection.position;
+      vertex.normal = intersection.normal;
+      vertex.incoming = state.direction;
+      vertex.material = object->material.get();
+      vertex.throughput = state.throughput;
+      vertex.dVCM = state.dVCM;
+      vertex.dVC = state.dVC;
+      lightVertices.push_back(vertex);
+
+      MappedPhoton photon;
+      photon.wavelength = wavelength;
+      photon.probability = ConnectToCamera(vertex, camera, wavelength,
+                                           screenDistribution,
+                                           monteCarloUnit,
+                                           photon.x, photon.y);
+      if (photon.probability > 0.0f) mappedPhotons.push_back(photon);
+    }
+
+    if (!Scatter(state, intersection, *object->material, wavelength,
+                 depth, monteCarloUnit)) return;
+  }
+}
+
+float BidirectionalTracer::TraceCameraSubpath(const Camera& camera,
+  const float x, const float y, const float wavelength,
+  const float screenWeight, const float totalPower,
+  MonteCarloUnit& monteCarloUnit)
+{
+  const Ray cameraRay = camera.GetRay(x, y, wavelength, monteCarloUnit);
+
+  // The probability density of the direction of the camera ray, with
+  // the probability of the screen position that was actually used
+  const float cameraProbability = aspectRatio * 0.25f / screenWeight
+    * camera.GetScreenToSolidAngleFactor(cameraRay.direction, wavelength);
+
+  SubpathState state;
+  state.origin = cameraRay.origin;
+  state.direction = cameraRay.direction;
+  state.throughput = screenWeight;
+  state.dVCM = Mis(1.0f / cameraProbability);
+  state.dVC = 0.0f;
+  state.survivalScale = scene.GetMaximumIntensity(wavelength);
+
+  float contribution = 0.0f;
+
+  for (int depth = 0; ; depth++)
+  {
+    Ray ray;
+    ray.origin = state.origin + state.direction * 0.00001f;
+    ray.direction = state.direction;
+    ray.wavelength = wavelength;
+
+    Intersection intersection;
+    const Object* object = scene.Intersect(ray, intersection);
+    if (!object) return contribution;
+
+    const float cosIn = std::abs(Dot(state.direction, intersection.normal));
+    if (cosIn <= 0.0f) return contribution;
+    const float distanceSquared = intersection.distance
+                                * intersection.distance;
+    state.dVCM *= Mis(distanceSquared);
+    state.dVCM /= Mis(cosIn);
+    state.dVC /= Mis(cosIn);
+
+    // If a light was hit, the path ends. Light that is seen directly
+    // can only be found this way, otherwise the path could have been
+    // sampled by the light subpath as well.
+    if (!object->material)
+    {
+      const float intensity =
+        object->emissiveMaterial->GetIntensity(wavelength);
+
+      if (depth == 0) return contribution + state.throughput * intensity;
+
+      const float area = object->surface->GetArea();
+      const float directProbability = area > 0.0f && totalPower > 0.0f
+                                    ? intensity / totalPower : 0.0f;
+      const float emissionProbability = directProbability * cosIn
+                                      / static_cast<float>(pi);
+      const float weightCamera = Mis(directProbability) * state.dVCM
+                               + Mis(emissionProbability) * state.dVC;
+
+      return contribution
+           + state.throughput * intensity / (1.0f + weightCamera);
+    }
+
+    if (object->material->IsDiffuse())
+    {
+      PathVertex vertex;
+      vertex.position = intersection.position;
+      vertex.normal = intersection.normal;
+      vertex.incoming = state.direction;
+      vertex.material = object->material.get();
+      vertex.throughput = state.throughput;
+      vertex.dVCM = state.dVCM;
+      vertex.dVC = state.dVC;
+
+      contribution += ConnectToLight(vertex, wavelength, totalPower,
+                                     monteCarloUnit);
+
+      for (auto& lightVertex : lightVertices)
+      {
+        contribution += ConnectVertices(vertex, lightVertex, wavelength);
+      }
+    }
+
+    if (!Scatter(state, intersection, *object->material, wavelength,
+                 depth, monteCarloUnit)) return contribution;
+  }
+}
+
+float BidirectionalTracer::ConnectToCamera(const PathVertex& vertex,
+  const Camera& camera, const float wavelength,
+  const ScreenDistribution& screenDistribution,
+  MonteCarloUnit& monteCarloUnit, float& x, float& y) const
+{
+  const Vector3 lensPosition = camera.GetLensPosition(monteCarloUnit);
+  if (!camera.GetScreenPosition(lensPosition, vertex.position, wavelength,
+                                aspectRatio, x, y)) return 0.0f;
+
+  Vector3 toCamera = lensPosition - vertex.position;
+  const float distanceSquared = toCamera.MagnitudeSquared();
+  toCamera = toCamera * (1.0f / std::sqrt(distanceSquared));
+
+  // Light can only be reflected towards the camera
+  // if the camera is on the same side of the surface
+  const float cosIn = Dot(vertex.incoming, vertex.normal);
+  const float cosOut = Dot(toCamera, vertex.normal);
+  if (cosIn * cosOut >= 0.0f) return 0.0f;
+
+  const float cosToCamera = std::abs(cosOut);
+  const float reflectance = vertex.material->GetReflectance(wavelength)
+                          / static_cast<float>(pi);
+
+  // The probability density (per unit area at the vertex) with which
+  // a camera ray would have hit the vertex, for a uniform distribution
+  // over the screen, and for the one that is actually used.
+  const float uniformProbability = aspectRatio * 0.25f
+    * camera.GetScreenToSolidAngleFactor(-toCamera, wavelength);
+  const float cameraProbability = uniformProbability
+    / screenDistribution.GetWeight(x, y) * cosToCamera / distanceSquared;
+  const float reverseProbability = std::abs(cosIn) / static_cast<float>(pi);
+
+  const float weightLight = Mis(cameraProbability)
+    * (vertex.dVCM + vertex.dVC * Mis(reverseProbability));
+
+  if (!scene.IsVisible(vertex.position, lensPosition)) return 0.0f;
+
+  // Photons traced from the camera sample the screen uniformly (after
+  // they are weighted), so this photon must be weighted as if it was
+  // found by a camera ray with the uniform probability.
+  return vertex.throughput * reflectance * cosToCamera * uniformProbability
+       / distanceSquared / (1.0f + weightLight);
+}
+
+float BidirectionalTracer::ConnectToLight(const PathVertex& vertex,
+                                          const float wavelength,
+                                          const float totalPower,
+                                          MonteCarloUnit& monteCarloUnit) const
+{
+  LightSample light;
+  if (!scene.SampleLight(wavelength, totalPower, monteCarloUnit, light))
+    return 0.0f;
+
+  Vector3 toLight = light.position - vertex.position;
+  const float distanceSquared = toLight.MagnitudeSquared();
+  toLight = toLight * (1.0f / std::sqrt(distanceSquared));
+
+  // The light only emits at the side of the normal that was sampled
+  const float cosAtLight = -Dot(toLight, light.normal);
+  if (cosAtLight <= 0.0f) return 0.0f;
+
+  // And light can only be reflected towards the camera if it arrives
+  // at the same side of the surface
+  const float cosIn = Dot(vertex.incoming, vertex.normal);
+  const float cosOut = Dot(toLight, vertex.normal);
+  if (cosIn * cosOut >= 0.0f) return 0.0f;
+
+  const float cosToLight = std::abs(cosOut);
+  const float reflectance = vertex.material->GetReflectance(wavelength)
+                          / static_cast<float>(pi);
+
+  // Probability densities (per unit solid angle) of the different ways
+  // in which this path could have been sampled
+  const float directProbability = light.probability * distanceSquared
+                                / cosAtLight;
+  const float emissionProbability = light.probability * cosAtLight
+                                  / static_cast<float>(pi);
+  const float forwardProbability = cosToLight / static_cast<float>(pi);
+  const float reverseProbability = std::abs(cosIn) / static_cast<float>(pi);
+
+  const float weightLight = Mis(forwardProbability / directProbability);
+  const float weightCamera = Mis(emissionProbability * cosToLight
+                                 / (directProbability * cosAtLight))
+    * (vertex.dVCM + vertex.dVC * Mis(reverseProbability));
+
+  if (!scene.IsVisible(vertex.position, light.position)) return 0.0f;
+
+  return vertex.throughput * light.intensity * reflectance * cosToLight
+       / directProbability / (1.0f + weightLight + weightCamera);
+}
+
+float BidirectionalTracer::ConnectVertices(const PathVertex& cameraVertex,
+                                           const PathVertex& lightVertex,
+                                           const float wavelength) const
+{
+  Vector3 direction = lightVertex.position - cameraVertex.position;
+  const float distanceSquared = direction.MagnitudeSquared();
+  if (distanceSquared <= 0.0f) return 0.0f;
+  direction = direction * (1.0f / std::sqrt(distanceSquared));
+
+  // Both vertices must reflect the light towards the side it came from
+  const float cameraCosIn = Dot(cameraVertex.incoming, cameraVertex.normal);
+  const float cameraCosOut = Dot(direction, cameraVertex.normal);
+  if (cameraCosIn * cameraCosOut >= 0.0f) return 0.0f;
+
+  const float lightCosIn = Dot(lightVertex.incoming, lightVertex.normal);
+  const float lightCosOut = -Dot(direction, lightVertex.normal);
+  if (lightCosIn * lightCosOut >= 0.0f) return 0.0f;
+
+  const float cosCamera = std::abs(cameraCosOut);
+  const float cosLight = std::abs(lightCosOut);
+  const float geometry = cosCamera * cosLight / distanceSquared;
+
+  const float cameraReflectance =
+    cameraVertex.material->GetReflectance(wavelength)
+    / static_cast<float>(pi);
+  const float lightReflectance =
+    lightVertex.material->GetReflectance(wavelength)
+    / static_cast<float>(pi);
+
+  // Probability densities (per unit area) of sampling the other vertex
+  // from either side, and the densities of reversing the subpaths
+  const float cameraProbability = cosCamera / static_cast<float>(pi)
+                                * cosLight / distanceSquared;
+  const float lightProbability = cosLight / static_cast<float>(pi)
+                               * cosCamera / distanceSquared;
+  const float cameraReverse = std::abs(cameraCosIn) / static_cast<float>(pi);
+  const float lightReverse = std::abs(lightCosIn) / static_cast<float>(pi);
+
+  const float weightLight = Mis(cameraProbability)
+    * (lightVertex.dVCM + lightVertex.dVC * Mis(lightReverse));
+  const float weightCamera = Mis(lightProbability)
+    * (cameraVertex.dVCM + cameraVertex.dVC * Mis(cameraReverse));
+
+  const float contribution = cameraVertex.throughput * cameraReflectance
+                           * geometry * lightReflectance
+                           * lightVertex.throughput;
+  if (contribution <= 0.0f) return 0.0f;
+
+  if (!scene.IsVisible(cameraVertex.position, lightVertex.position))
+    return 0.0f;
+
+  return contribution / (1.0f + weightLight + weightCamera);
+}
+
+bool BidirectionalTracer::Scatter(SubpathState& state,
+                                  const Intersection& intersection,
+                                  const Material& material,
+                                  const float wavelength, const int depth,
+                                  MonteCarloUnit& monteCarloUnit) const
+{
+  Ray incoming;
+  incoming.origin = state.origin;
+  incoming.direction = state.direction;
+  incoming.wavelength = wavelength;
+  incoming.probability = 1.0f;
+
+  const Ray ray = material.GetNewRay(incoming, intersection, monteCarloUnit);
+  const float cosIn = std::abs(Dot(state.direction, intersection.normal));
+  const float cosOut = std::abs(Dot(ray.direction, intersection.normal));
+
+  if (material.IsDiffuse())
+  {
+    // The new direction is cosine-weighted
+    const float forwardProbability = cosOut / static_cast<float>(pi);
+    const float reverseProbability = cosIn / static_cast<float>(pi);
+    if (forwardProbability <= 0.0f) return false;
+
+    state.dVC = Mis(cosOut / forwardProbability)
+              * (state.dVC * Mis(reverseProbability) + state.dVCM);
+    state.dVCM = Mis(1.0f / forwardProbability);
+  }
+  else
+  {
+    // Other materials can not be connected to, so they act like
+    // perfectly specular ones
+    state.dVCM = 0.0f;
+    state.dVC *= Mis(cosOut);
+  }
+
+  state.origin = intersection.position;
+  state.direction = ray.direction;
+  state.throughput *= ray.probability;
+
+  // After a few bounces, play Russian roulette on the throughput, like
+  // the path tracer does. The throughput of a camera subpath is scaled
+  // by the brightest light it can find, that of a light subpath is
+  // relative to the light it left.
+  if (depth + 1 >= TraceUnit::minimumDepth)
+  {
+    const float survivalChance = std::min(TraceUnit::maximumSurvivalChance,
+                                          state.throughput
+                                          * state.survivalScale);
+    if (monteCarloUnit.GetUnit() >= survivalChance) return false;
+    state.throughput /= survivalChance;
+  }
+
+  return state.throughput > 0.0f;
+}
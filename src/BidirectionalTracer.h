@@ -0,0 +1,150 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+#include "MappedPhoton.h"
+#include "Vector3.h"
+#include "Intersection.h"
+
+namespace Luculentus
+{
+  class Camera;
+  class Material;
+  class MonteCarloUnit;
+  class Scene;
+  class ScreenDistribution;
+
+  /// Renders paths by tracing a subpath from the camera and one from a
+  /// light source, and connecting the vertices of the two. The
+  /// strategies are combined with multiple importance sampling, using
+  /// the recursive formulation from "Implementing Vertex Connection and
+  /// Merging" (Georgiev, 2012).
+  ///
+  /// Only diffuse vertices can be connected; all other materials are
+  /// treated as if they were perfectly specular.
+  class BidirectionalTracer
+  {
+    public:
+
+      /// The scene that will be rendered.
+      const Scene& scene;
+
+      /// The aspect ratio of the image that will be rendered
+      const float aspectRatio;
+
+      /// Creates a tracer for the specified scene.
+      BidirectionalTracer(const Scene& scn, const float aspect);
+
+      /// Traces one camera subpath through the specified screen
+      /// position and one light subpath. Appends the photons that the
+      /// light subpath splatted directly onto the screen, and returns
+      /// the probability of the photon for the screen position.
+      float Render(const float x, const float y, const float wavelength,
+                  const float screenWeight,
+                  const ScreenDistribution& screenDistribution,
+                  MonteCarloUnit& monteCarloUnit,
+                  std::vector<MappedPhoton>& mappedPhotons);
+
+    private:
+
+      /// A point on a diffuse surface where a subpath scattered.
+      struct PathVertex
+      {
+        /// The position of the vertex.
+        Vector3 position;
+
+        /// The surface normal at the vertex.
+        Vector3 normal;
+
+        /// The direction in which the subpath arrived at the vertex.
+        Vector3 incoming;
+
+        /// The material of the surface.
+        const Material* material;
+
+        /// The contribution of the subpath up to the vertex, divided by
+        /// the probability of sampling it.
+        float throughput;
+
+        /// Partial MIS quantities for vertex connection, see the paper.
+        float dVCM, dVC;
+      };
+
+      /// The state of a subpath while it is being traced.
+      struct SubpathState
+      {
+        Vector3 origin;
+        Vector3 direction;
+        float throughput;
+        float dVCM, dVC;
+
+        /// Turns the throughput into the chance that the subpath
+        /// survives Russian roulette.
+        float survivalScale;
+      };
+
+      /// The diffuse vertices of the current light subpath.
+      std::vector<PathVertex> lightVertices;
+
+      /// Traces a subpath from a light source, storing its diffuse
+      /// vertices, and splatting the ones that are visible to the camera.
+      void TraceLightSubpath(const Camera& camera, const float wavelength,
+                             const float totalPower,
+                             const ScreenDistribution& screenDistribution,
+                             MonteCarloUnit& monteCarloUnit,
+                             std::vector<MappedPhoton>& mappedPhotons);
+
+      /// Traces a subpath from the camera, connecting its diffuse
+      /// vertices to the light sources and to the light subpath, and
+      /// returns the contribution to the screen position.
+      float TraceCameraSubpath(const Camera& camera,
+                               const float x, const float y,
+                               const float wavelength,
+                               const float screenWeight,
+                               const float totalPower,
+                               MonteCarloUnit& monteCarloUnit);
+
+      /// Returns the contribution of a light subpath vertex connected
+      /// directly to a point on the camera lens, and sets the screen
+      /// position it maps to. Returns 0 if it does not hit the screen.
+      float ConnectToCamera(const PathVertex& vertex, const Camera& camera,
+                            const float wavelength,
+                            const ScreenDistribution& screenDistribution,
+                            MonteCarloUnit& monteCarloUnit,
+                            float& x, float& y) const;
+
+      /// Returns the contribution of a point on a light source connected
+      /// to a camera subpath vertex (next event estimation).
+      float ConnectToLight(const PathVertex& vertex, const float wavelength,
+                           const float totalPower,
+                           MonteCarloUnit& monteCarloUnit) const;
+
+      /// Returns the contribution of a camera subpath vertex connected
+      /// to a light subpath vertex.
+      float ConnectVertices(const PathVertex& cameraVertex,
+                            const PathVertex& lightVertex,
+                            const float wavelength) const;
+
+      /// Updates the subpath state after the material at the vertex
+      /// scattered it, and plays Russian roulette. Returns false if the
+      /// subpath ends.
+      bool Scatter(SubpathState& state, const Intersection& intersection,
+                   const Material& material, const float wavelength,
+                   const int depth, MonteCarloUnit& monteCarloUnit) const;
+  };
+}
@@ -18,19 +18,74 @@
 
 #include <cmath>
 #include "Constants.h"
+#include "FastMath.h"
 #include "Quaternion.h"
 #include "MonteCarloUnit.h"
 
 using namespace Luculentus;
 
-Ray Camera::GetScreenRay(const float x, const float y,
-                         const float chromaticAberrationFactor,
-                         const float dofAngle,
-                         const float dofRadius) const
+void Camera::Precompute()
 {
+  rotation = MakeRotationMatrix(orientation);
+
   // The smaller the FOV, the further the screen is away;
   // the larger the FOV, the closer the screen is.
-  float screenDistance = 1.0f / std::tan(fieldOfView * 0.5f);
+  screenDistance = 1.0f / std::tan(fieldOfView * 0.5f);
+}
+
+Camera Camera::Interpolate(const Camera& a, const Camera& b, const float f)
+{
+  Camera camera;
+  camera.position = a.position + (b.position - a.position) * f;
+  camera.fieldOfView = a.fieldOfView + (b.fieldOfView - a.fieldOfView) * f;
+  camera.focalDistance = a.focalDistance
+                       + (b.focalDistance - a.focalDistance) * f;
+  camera.depthOfField = a.depthOfField + (b.depthOfField - a.depthOfField) * f;
+  camera.chromaticAberration = a.chromaticAberration
+    + (b.chromaticAberration - a.chromaticAberration) * f;
+  camera.orientation = a.orientation + (b.orientation - a.orientation) * f;
+  camera.orientation.Normalise();
+
+  // A rotation matrix interpolated entry by entry would not be a
+  // rotation any more, so it is made from the normalised quaternion.
+  // Nearby cameras differ so little that linear interpolation of the
+  // screen distance is as good as computing it again.
+  camera.rotation = MakeRotationMatrix(camera.orientation);
+  camera.screenDistance = a.screenDistance
+                        + (b.screenDistance - a.screenDistance) * f;
+
+  return camera;
+}
+
+float Camera::GetChromaticZoom(const float wavelength) const
+{
+  const float d = (wavelength - 580.0f) / 200.0f;
+  return 1.0f + d * chromaticAberration;
+}
+
+Vector3 Camera::GetLensPoint(MonteCarloUnit& monteCarloUnit) const
+{
+  // Pick depth of field coordinates randomly.
+  const float dofAngle = monteCarloUnit.GetLongitude();
+  const float dofRadius = monteCarloUnit.GetUnit() / depthOfField;
+
+  // Then take a new point on the camera 'lens' (this is of course not
+  // accurate, but then again, the pinhole camera does not have depth of
+  // field at all, so it is a hack anyway).
+  Vector3 lensPoint =
+  {
+    FastMath::Cos(dofAngle) * dofRadius,
+    0.0f,
+    FastMath::Sin(dofAngle) * dofRadius
+  };
+
+  return lensPoint;
+}
+
+Ray Camera::GetScreenRay(const float x, const float y,
+                         const float chromaticAberrationFactor,
+                         const Vector3 lensPoint) const
+{
   Vector3 direction = { x, screenDistance, -y };
 
   // Then apply some wavelength dependent zoom to create chromatic
@@ -41,26 +96,16 @@ Ray Camera::GetScreenRay(const float x, const float y,
   direction.z *= chromaticAberrationFactor;
   
   // Now find the intersection with the focal plane (which is trivial as
-  // long as the ray is not transformed yet).
-  direction.Normalise();
-  Vector3 focusPoint = direction * (focalDistance / direction.y);
+  // long as the ray is not transformed yet, and which does not depend
+  // on the length of the direction).
+  Vector3 focusPoint = direction * (focalDistance / screenDistance);
 
-  // Then take a new point on the camera 'lens' (this is of course not
-  // accurate, but then again, the pinhole camera does not have depth of
-  // field at all, so it is a hack anyway).
-  Vector3 lensPoint =
-  {
-    std::cos(dofAngle) * dofRadius,
-    0.0f,
-    std::sin(dofAngle) * dofRadius
-  };
-  
   // Then construct the new ray,
   // from the lens point through the focus point.
   direction = focusPoint - lensPoint;
   Ray r;
-  r.direction = Rotate(direction, orientation);
-  r.origin = position + Rotate(lensPoint, orientation);
+  r.direction = rotation * direction;
+  r.origin = position + rotation * lensPoint;
   r.direction.Normalise();
 
   return r;
@@ -69,19 +114,59 @@ Ray Camera::GetScreenRay(const float x, const float y,
 Ray Camera::GetRay(const float x, const float y, const float wavelength,
                    MonteCarloUnit& monteCarloUnit) const
 {
-  // Pick depth of field coordinates randomly.
-  const float dofAngle = monteCarloUnit.GetLongitude();
-  const float dofRadius = monteCarloUnit.GetUnit() / depthOfField;
-
   // Calculate a zoom factor based on the wavelenth
   // to simulate chromatic aberration of the lens.
-  const float d = (wavelength - 580.0f) / 200.0f;
-  const float chromaticZoom = 1.0f + d * chromaticAberration;
+  const float chromaticZoom = GetChromaticZoom(wavelength);
 
-  Ray r = GetScreenRay(x, y, chromaticZoom, dofAngle, dofRadius);
+  Ray r = GetScreenRay(x, y, chromaticZoom, GetLensPoint(monteCarloUnit));
   r.wavelength = wavelength;
 
   r.probability = 1.0f;
 
   return r;
 }
+
+Vector3 Camera::GetLensPosition(MonteCarloUnit& monteCarloUnit) const
+{
+  return position + rotation * GetLensPoint(monteCarloUnit);
+}
+
+bool Camera::GetScreenPosition(const Vector3 lensPosition,
+                               const Vector3 target, const float wavelength,
+                               const float aspectRatio,
+                               float& x, float& y) const
+{
+  // Transform both points back into camera space.
+  const Vector3 lensPoint = TransposeMultiply(rotation,
+                                              lensPosition - position);
+  const Vector3 direction = TransposeMultiply(rotation,
+                                              target - lensPosition);
+
+  // Points behind the lens can not be seen.
+  if (direction.y <= 0.0f) return false;
+
+  // Every ray through a point on the focal plane originates from the
+  // same screen position, so find the point where this one crosses it,
+  // and then undo the transformation of GetScreenRay.
+  const Vector3 focusPoint = lensPoint
+    + direction * ((focalDistance - lensPoint.y) / direction.y);
+  const float scale = screenDistance
+                    / (GetChromaticZoom(wavelength) * focalDistance);
+  x =  focusPoint.x * scale;
+  y = -focusPoint.z * scale;
+
+  return std::abs(x) <= 1.0f && std::abs(y) <= 1.0f / aspectRatio;
+}
+
+float Camera::GetScreenToSolidAngleFactor(const Vector3 direction,
+                                          const float wavelength) const
+{
+  // A patch on the screen maps to a patch on the focal plane, which
+  // is seen from the lens under a solid angle proportional to the
+  // cube of the cosine of the angle with the optical axis.
+  const float cosTheta = Dot(direction, rotation.y);
+  const float s = screenDistance;
+  const float c = GetChromaticZoom(wavelength);
+
+  return (s * s) / (c * c * cosTheta * cosTheta * cosTheta);
+}
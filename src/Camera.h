@@ -17,6 +17,7 @@
 #pragma once
 
 #include "Vector3.h"
+#include "Matrix3.h"
 #include "Quaternion.h"
 #include "Ray.h"
 
@@ -50,18 +51,58 @@ namespace Luculentus
       /// The direction in which the camera is looking.
       Quaternion orientation;
 
+      /// Derives the constants that rays are generated with from the
+      /// properties above. Must be called after changing them, before
+      /// generating rays.
+      void Precompute();
+
+      /// Interpolates linearly between two precomputed cameras, which
+      /// is much cheaper than computing a camera in between.
+      static Camera Interpolate(const Camera& a, const Camera& b,
+                                const float f);
+
       /// Returns a camera ray through the screen at the specified
       /// position, where -1.0 is left and 1.0 right, with square units.
       Ray GetRay(const float x, const float y, const float wavelength,
                  MonteCarloUnit& monteCarloUnit) const;
 
+      /// Picks a point on the lens (in world space), with the same
+      /// distribution GetRay uses.
+      Vector3 GetLensPosition(MonteCarloUnit& monteCarloUnit) const;
+
+      /// Finds the screen position for which a ray from the specified
+      /// point on the lens passes through the target. Returns false if
+      /// the target lies behind the camera or outside of the screen.
+      bool GetScreenPosition(const Vector3 lensPosition,
+                             const Vector3 target, const float wavelength,
+                             const float aspectRatio,
+                             float& x, float& y) const;
+
+      /// Returns the factor that converts a probability density over
+      /// the screen into a density over the solid angle of rays leaving
+      /// the lens in the specified (normalised) direction.
+      float GetScreenToSolidAngleFactor(const Vector3 direction,
+                                        const float wavelength) const;
+
     private:
 
+      /// The orientation, as a rotation matrix.
+      Matrix3 rotation;
+
+      /// The distance between the pinhole and the screen.
+      float screenDistance;
+
+      /// Returns the wavelength dependent zoom factor that simulates
+      /// chromatic aberration.
+      float GetChromaticZoom(const float wavelength) const;
+
+      /// Picks a point on the lens, in camera space.
+      Vector3 GetLensPoint(MonteCarloUnit& monteCarloUnit) const;
+
       /// Returns a ray through the screen,
       /// where -1.0 is left, 1.0 is right, and the units are square.
       Ray GetScreenRay(const float x, const float y,
                        const float chromaticAberrationFactor,
-                       const float dofAngle,
-                       const float dofRadius) const;
+                       const Vector3 lensPoint) const;
   };
 }
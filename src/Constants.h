@@ -20,6 +20,8 @@ namespace Luculentus
 {
   const double pi = 3.1415926535897932384626433832795028841971693993751058f;
 
+  const double ln2 = 0.6931471805599453094172321214581765680755001343602553;
+
   const double goldenRatio = 1.6180339887498948482045868343656381177203091798057628;
 
   const double plancksConstant = 6.62606957e-34;
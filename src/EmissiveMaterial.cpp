@@ -44,13 +44,17 @@ BlackBodyMaterial::BlackBodyMaterial(const float kelvins,
   , normalisationFactor(intensity
     / boltzmann(static_cast<float>((wiensConstant / kelvins) * 1.0e9),
     kelvins))
+  , intensityCurve([=](const float wavelength)
+    {
+      // The intensity for a specified wavelength,
+      // is the normalised Boltzmann distribution.
+      return boltzmann(wavelength, kelvins) * normalisationFactor;
+    })
 {
 
 }
 
 float BlackBodyMaterial::GetIntensity(const float wavelength) const
 {
-  // The intensity for a specified wavelength,
-  // is the normalised Boltzmann distribution.
-  return boltzmann(wavelength, temperature) * normalisationFactor;
+  return intensityCurve(wavelength);
 }
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include "SpectralCurve.h"
+
 namespace Luculentus
 {
   class EmissiveMaterial
@@ -46,5 +48,10 @@ namespace Luculentus
       BlackBodyMaterial(const float kelvins, const float intensity);
 
       virtual float GetIntensity(const float wavelength) const;
+
+    private:
+
+      /// The normalised distribution, sampled once.
+      SpectralCurve intensityCurve;
   };
 }
@@ -0,0 +1,171 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "Constants.h"
+
+namespace Luculentus
+{
+  /// Approximations of the transcendental functions that are evaluated
+  /// per path or per pixel. They are branch-free polynomials, so the
+  /// compiler can inline and vectorise them. The error bounds below
+  /// include rounding.
+  ///
+  /// Define LUCULENTUS_PRECISE_MATH to use the standard library
+  /// functions instead, for reference images (make precise).
+  class FastMath
+  {
+    public:
+
+      /// Sine of x, for |x| < 2^22. Absolute error below 4e-6.
+      inline static float Sin(const float x)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::sin(x);
+        #else
+        // Reduce to r in [-pi/2, pi/2], where sin(x) = (-1)^k sin(r)
+        const float k = Round(x * static_cast<float>(1.0 / pi));
+        const float r = x - k * static_cast<float>(pi);
+        const float sign = (static_cast<int32_t>(k) & 1) ? -1.0f : 1.0f;
+
+        // The Taylor series up to r^9
+        const float s = r * r;
+        const float p = 1.0f + s * (-1.0f / 6.0f + s * (1.0f / 120.0f
+                      + s * (-1.0f / 5040.0f + s * (1.0f / 362880.0f))));
+        return sign * r * p;
+        #endif
+      }
+
+      /// Cosine of x, for |x| < 2^22. Absolute error below 4e-6.
+      inline static float Cos(const float x)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::cos(x);
+        #else
+        return Sin(x + static_cast<float>(pi * 0.5));
+        #endif
+      }
+
+      /// Arc cosine of x, for x in [-1, 1]. Absolute error below 5e-7.
+      inline static float Acos(const float x)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::acos(x);
+        #else
+        // See Abramowitz and Stegun, formula 4.4.46
+        const float a = std::abs(x);
+        const float p = 1.5707963050f + a * (-0.2145988016f
+                      + a * (0.0889789874f + a * (-0.0501743046f
+                      + a * (0.0308918810f + a * (-0.0170881256f
+                      + a * (0.0066700901f + a * -0.0012624911f))))));
+        const float y = std::sqrt(1.0f - a) * p;
+        return x < 0.0f ? static_cast<float>(pi) - y : y;
+        #endif
+      }
+
+      /// Base-2 logarithm of x, for positive normal x. Absolute error
+      /// below 1e-7 near 1, and below 1 ulp of the result elsewhere.
+      inline static float Log2(const float x)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::log2(x);
+        #else
+        // Split x into m 2^e with m in [sqrt(1/2), sqrt(2)) (the exponent
+        // is negative below sqrt(1/2), so it is multiplied rather than
+        // shifted into place)
+        int32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        const int32_t offset = bits - 0x3f3504f3;
+        const int32_t e = offset >> 23;
+        bits -= e * (1 << 23);
+        float m;
+        std::memcpy(&m, &bits, sizeof(m));
+
+        // ln(m) = 2 atanh(t), with |t| < 0.172, so the series converges
+        // quickly
+        const float t = (m - 1.0f) / (m + 1.0f);
+        const float s = t * t;
+        const float lnM = 2.0f * t * (1.0f + s * (1.0f / 3.0f + s * (1.0f / 5.0f
+                        + s * (1.0f / 7.0f + s * (1.0f / 9.0f)))));
+        return static_cast<float>(e) + lnM * static_cast<float>(1.0 / ln2);
+        #endif
+      }
+
+      /// Natural logarithm of x, for positive normal x. Absolute error
+      /// below 1e-7 near 1, and below 1 ulp of the result elsewhere.
+      inline static float Log(const float x)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::log(x);
+        #else
+        return Log2(x) * static_cast<float>(ln2);
+        #endif
+      }
+
+      /// 2 to the power x, for x in [-126, 127].
+      /// Relative error below 3e-7.
+      inline static float Exp2(const float x)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::exp2(x);
+        #else
+        // Split x into n + f with f in [-1/2, 1/2]
+        const float n = Round(x);
+        const float f = (x - n) * static_cast<float>(ln2);
+
+        // The Taylor series of e^f up to f^6
+        const float p = 1.0f + f * (1.0f + f * (1.0f / 2.0f + f * (1.0f / 6.0f
+                      + f * (1.0f / 24.0f + f * (1.0f / 120.0f
+                      + f * (1.0f / 720.0f))))));
+
+        // Multiply by 2^n by adding n to the exponent (n may be negative,
+        // so it is multiplied rather than shifted into place)
+        int32_t bits;
+        std::memcpy(&bits, &p, sizeof(bits));
+        bits += static_cast<int32_t>(n) * (1 << 23);
+        float y;
+        std::memcpy(&y, &bits, sizeof(y));
+        return y;
+        #endif
+      }
+
+      /// x to the power y, for positive normal x, as long as the result
+      /// is a normal float. Relative error below 1e-6 for |y log2(x)|
+      /// below 4.
+      inline static float Pow(const float x, const float y)
+      {
+        #ifdef LUCULENTUS_PRECISE_MATH
+        return std::pow(x, y);
+        #else
+        return Exp2(y * Log2(x));
+        #endif
+      }
+
+    private:
+
+      /// Rounds to the nearest integer, for |x| < 2^22.
+      inline static float Round(const float x)
+      {
+        // Adding and subtracting 1.5 * 2^23 drops the fraction
+        const float magic = 12582912.0f;
+        return (x + magic) - magic;
+      }
+  };
+}
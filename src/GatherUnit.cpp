@@ -16,27 +16,208 @@
 
 #include "GatherUnit.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include "Half.h"
+#include "Platform.h"
 #include "PlotUnit.h"
+#include "Settings.h"
 
 using namespace Luculentus;
 
-GatherUnit::GatherUnit(const int width, const int height)
+GatherUnit::GatherUnit(const int width, const int height, const int bands,
+                       const bool compensated)
   : imageWidth(width)
   , imageHeight(height)
+  , numberOfBands(bands)
+  , isCompensated(compensated)
 {
-  // Allocate a buffer to store the tristimulus values,
+  // Allocate a buffer to store the tristimulus values (or spectra),
   // and fill it with black.
-  tristimulusBuffer.resize(imageWidth * imageHeight, ZeroVector3());
+  if (numberOfBands > 0)
+  {
+    AllocateBuffer(spectralBuffer, imageWidth * imageHeight * numberOfBands,
+                   0.0f);
+    if (isCompensated)
+      AllocateBuffer(spectralCompensation, spectralBuffer.size(), 0.0f);
+  }
+  else
+  {
+    AllocateBuffer(tristimulusBuffer, imageWidth * imageHeight, ZeroVector3());
+    if (isCompensated)
+      AllocateBuffer(tristimulusCompensation, tristimulusBuffer.size(),
+                     ZeroVector3());
+  }
+
+  // No photons have been gathered yet.
+  tileStatistics.resize(ScreenDistribution::GetNumberOfTiles(width, height),
+                        ZeroTileStatistics());
 }
 
 void GatherUnit::Accumulate(PlotUnit& plotUnit)
 {
-  // Loop through all pixels, and add the values.
-  for (int i = 0; i < imageWidth * imageHeight; i++)
+  Accumulate(plotUnit, 0, 1);
+  AccumulateStatistics(plotUnit);
+}
+
+void GatherUnit::Accumulate(PlotUnit& plotUnit, const int part,
+                            const int numberOfParts)
+{
+  static_assert(sizeof(Vector3) == 3 * sizeof(float),
+                "tristimulus values are added as floats");
+
+  // The rows of the strip
+  const int rowsPerPart = (imageHeight + numberOfParts - 1) / numberOfParts;
+  const int beginRow = std::min(imageHeight, part * rowsPerPart);
+  const int endRow = std::min(imageHeight, beginRow + rowsPerPart);
+
+  // Add the values of the strip, and clear those of the plot unit in
+  // the same pass. A plot unit that never plotted has nothing to add.
+  if (!tristimulusBuffer.empty() && !plotUnit.tristimulusBuffer.empty())
+  {
+    AccumulatePixels(&plotUnit.tristimulusBuffer[0], beginRow * imageWidth,
+                     endRow * imageWidth);
+  }
+
+  // Or the spectra.
+  if (!spectralBuffer.empty() && !plotUnit.spectralBuffer.empty())
+  {
+    float* values = &plotUnit.spectralBuffer[0];
+    const int begin = beginRow * imageWidth * numberOfBands;
+    const int end = endRow * imageWidth * numberOfBands;
+    for (int i = begin; i < end; i++)
+    {
+      if (isCompensated)
+        CompensatedAdd(spectralBuffer[i], spectralCompensation[i], values[i]);
+      else
+        spectralBuffer[i] += values[i];
+      values[i] = 0.0f;
+    }
+  }
+}
+
+void GatherUnit::AccumulatePixels(Vector3* pixels, const int begin,
+                                  const int end)
+{
+  // The loop runs over contiguous floats, so the compiler can
+  // vectorise it
+  float* sums = reinterpret_cast<float*>(&tristimulusBuffer[0]);
+  float* values = reinterpret_cast<float*>(pixels);
+  if (isCompensated)
+  {
+    float* compensation =
+      reinterpret_cast<float*>(&tristimulusCompensation[0]);
+    for (int i = begin * 3; i < end * 3; i++)
+    {
+      CompensatedAdd(sums[i], compensation[i], values[i]);
+      values[i] = 0.0f;
+    }
+  }
+  else
+  {
+    for (int i = begin * 3; i < end * 3; i++)
+    {
+      sums[i] += values[i];
+      values[i] = 0.0f;
+    }
+  }
+}
+
+void GatherUnit::AccumulateStatistics(PlotUnit& plotUnit)
+{
+  for (size_t i = 0; i < tileStatistics.size(); i++)
   {
-    tristimulusBuffer[i] += plotUnit.tristimulusBuffer[i];
+    tileStatistics[i] += plotUnit.tileStatistics[i];
+    plotUnit.tileStatistics[i] = ZeroTileStatistics();
   }
+}
+
+float GatherUnit::GetRelativeError() const
+{
+  double sumOfSquaredErrors = 0.0;
+  int litTiles = 0;
+
+  for (auto stats : tileStatistics)
+  {
+    // Tiles that received no light do not count, they are black.
+    if (stats.sum <= 0.0) continue;
+    litTiles++;
+
+    // Assume the worst if there is not enough data.
+    if (stats.count < ScreenDistribution::minimumCount)
+    {
+      sumOfSquaredErrors += 1.0;
+      continue;
+    }
+
+    // The standard error of the mean of the tile, relative to the mean.
+    const double mean = stats.sum / stats.count;
+    const double variance = std::max(0.0, stats.sumOfSquares / stats.count
+                                          - mean * mean);
+    const double error = std::sqrt(variance / (stats.count - 1.0)) / mean;
+    sumOfSquaredErrors += error * error;
+  }
+
+  if (litTiles == 0) return 1.0f;
+
+  return static_cast<float>(std::sqrt(sumOfSquaredErrors / litTiles));
+}
+
+bool GatherUnit::SaveSpectra(const std::string& fileName) const
+{
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+
+  // The gathered light can exceed the range of half floats, so they are
+  // stored relative to a scale that maps the brightest value to nearly
+  // the largest half float.
+  const float maximum = spectralBuffer.empty() ? 0.0f
+    : *std::max_element(spectralBuffer.begin(), spectralBuffer.end());
+  const float scale = maximum > 0.0f ? maximum / 60000.0f : 1.0f;
+
+  std::vector<std::uint16_t> halves(spectralBuffer.size());
+  for (size_t i = 0; i < halves.size(); i++)
+    halves[i] = FloatToHalf(spectralBuffer[i] / scale);
+
+  // A header like that of a PPM file, followed by the raw half floats,
+  // band by band for every pixel, in the byte order of the machine. The
+  // scale is written with enough digits to read back the same float.
+  file << "Luculentus spectra\n" << imageWidth << " " << imageHeight << " "
+       << numberOfBands << "\n" << std::setprecision(9) << scale << "\n";
+  file.write(reinterpret_cast<const char*>(&halves[0]),
+             halves.size() * sizeof(std::uint16_t));
+
+  return file.good();
+}
+
+bool GatherUnit::LoadSpectra(const std::string& fileName)
+{
+  std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+
+  std::string magic;
+  std::getline(file, magic);
+  int width = 0, height = 0, bands = 0;
+  float scale = 0.0f;
+  file >> width >> height >> bands >> scale;
+  file.get();
+
+  if (!file.good() || magic != "Luculentus spectra" || width != imageWidth
+      || height != imageHeight || bands <= 0
+      || bands > Settings::maximumSpectralBands) return false;
+
+  std::vector<std::uint16_t> halves(imageWidth * imageHeight * bands);
+  file.read(reinterpret_cast<char*>(&halves[0]),
+            halves.size() * sizeof(std::uint16_t));
+  if (!file.good()) return false;
+
+  numberOfBands = bands;
+  tristimulusBuffer.clear();
+  tristimulusCompensation.clear();
+  spectralBuffer.resize(halves.size());
+  if (isCompensated) spectralCompensation.assign(halves.size(), 0.0f);
+  for (size_t i = 0; i < halves.size(); i++)
+    spectralBuffer[i] = HalfToFloat(halves[i]) * scale;
 
-  // Then clear the buffer of the plot unit, so it can be recycled.
-  plotUnit.Clear();
+  return true;
 }
@@ -16,13 +16,26 @@
 
 #pragma once
 
+#include <string>
 #include <vector>
+#include "ScreenDistribution.h"
 #include "Vector3.h"
 
 namespace Luculentus
 {
   class PlotUnit;
 
+  /// Adds the value to the sum, carrying the bits that are lost in the
+  /// addition over to the next addition (Kahan summation).
+  template <typename T>
+  inline void CompensatedAdd(T& sum, T& compensation, const T value)
+  {
+    const T corrected = value - compensation;
+    const T newSum = sum + corrected;
+    compensation = (newSum - sum) - corrected;
+    sum = newSum;
+  }
+
   /// Handles combining the results of multiple PlotUnits.
   class GatherUnit
   {
@@ -37,12 +50,72 @@ namespace Luculentus
       /// The buffer of tristimulus values.
       std::vector<Vector3> tristimulusBuffer;
 
+      /// The number of spectral bands, or zero if the plot units record
+      /// tristimulus values.
+      int numberOfBands;
+
+      /// The light in every spectral band of every pixel, if the plot
+      /// units record spectra (the tristimulus buffer is empty then).
+      std::vector<float> spectralBuffer;
+
+      /// Statistics about all photons that were plotted into every tile.
+      std::vector<TileStatistics> tileStatistics;
+
       /// Constructs a new gather unit that will gather a canvas of the
-      /// specified size.
-      GatherUnit(const int width, const int height);
+      /// specified size, with the specified number of spectral bands
+      /// (zero to gather tristimulus values). Without compensation, the
+      /// sums take half the memory, but lose precision after long
+      /// renders.
+      GatherUnit(const int width, const int height, const int bands,
+                 const bool compensated);
 
       /// Add the results of the PlotUnit to the canvas,
       /// and then clears the PlotUnit, so it can be recycled.
       void Accumulate(PlotUnit& plotUnit);
+
+      /// Adds a part of the canvas of the PlotUnit to the canvas, and
+      /// clears that part of the PlotUnit in the same pass. The canvas is
+      /// divided into the specified number of horizontal strips, so that
+      /// different threads can accumulate different parts at once.
+      void Accumulate(PlotUnit& plotUnit, const int part,
+                      const int numberOfParts);
+
+      /// Adds the tristimulus values of the pixels from begin up to end
+      /// to the canvas, and clears them in the same pass.
+      void AccumulatePixels(Vector3* pixels, const int begin,
+                            const int end);
+
+      /// Adds the tile statistics of the PlotUnit, and clears them. Once
+      /// all parts of its canvas have been accumulated as well, the
+      /// PlotUnit can be recycled.
+      void AccumulateStatistics(PlotUnit& plotUnit);
+
+      /// Returns the root mean square of the relative standard error of
+      /// all tiles that received light. Tiles with too few photons to
+      /// tell count as having a relative error of 1.
+      float GetRelativeError() const;
+
+      /// Writes the spectra to a file as half floats, so they can be
+      /// tonemapped again later. Returns whether that succeeded.
+      bool SaveSpectra(const std::string& fileName) const;
+
+      /// Reads spectra written by SaveSpectra, replacing the gathered
+      /// ones. The film must be of the same size as the canvas. Returns
+      /// whether that succeeded.
+      bool LoadSpectra(const std::string& fileName);
+
+    private:
+
+      /// Whether the sums are compensated.
+      bool isCompensated;
+
+      /// The low-order bits of every sum in the tristimulus buffer and
+      /// the spectral buffer, that did not fit in the sum itself. After
+      /// hours of rendering, a single batch of photons is far smaller
+      /// than the sums, and without compensation it would barely change
+      /// them ("Further Remarks on Reducing Truncation Errors", Kahan,
+      /// 1965). Both are empty if the sums are not compensated.
+      std::vector<Vector3> tristimulusCompensation;
+      std::vector<float> spectralCompensation;
   };
 }
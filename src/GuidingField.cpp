@@ -0,0 +1,141 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "GuidingField.h"
+
+#include <algorithm>
+#include <cmath>
+#include "AtomicFloat.h"
+#include "Constants.h"
+#include "FastMath.h"
+#include "MonteCarloUnit.h"
+#include "SpatialHash.h"
+
+using namespace Luculentus;
+
+const float GuidingField::voxelSize = 1.0f;
+
+GuidingField::GuidingField()
+  : radianceSums(numberOfCells * numberOfBins)
+{
+  for (auto& sum : radianceSums) sum.store(0.0f);
+}
+
+void GuidingField::Record(const Vector3 position, const Vector3 direction,
+                          const float radiance, const float probability)
+{
+  if (radiance <= 0.0f || probability <= 0.0f) return;
+
+  AtomicAdd(radianceSums[GetCell(position) * numberOfBins
+                         + GetBin(direction)], radiance / probability);
+}
+
+int GuidingField::GetCell(const Vector3 position)
+{
+  const int x = static_cast<int>(std::floor(position.x / voxelSize));
+  const int y = static_cast<int>(std::floor(position.y / voxelSize));
+  const int z = static_cast<int>(std::floor(position.z / voxelSize));
+
+  return static_cast<int>(HashCell(x, y, z) % numberOfCells);
+}
+
+int GuidingField::GetBin(const Vector3 direction)
+{
+  // Bins of equal height along the z-axis have equal area on the
+  // sphere (Archimedes' hat-box theorem)
+  const float phi = std::atan2(direction.y, direction.x);
+  const int bz = static_cast<int>((direction.z * 0.5f + 0.5f) * binsZ);
+  const int bphi = static_cast<int>((phi / static_cast<float>(pi) * 0.5f
+                                     + 0.5f) * binsPhi);
+
+  return std::max(0, std::min(binsZ - 1, bz)) * binsPhi
+       + std::max(0, std::min(binsPhi - 1, bphi));
+}
+
+// --------------------
+
+GuidingDistribution::GuidingDistribution()
+{
+
+}
+
+GuidingDistribution::GuidingDistribution(const GuidingField& field)
+  : cumulativeProbability(GuidingField::numberOfCells
+                          * GuidingField::numberOfBins)
+  , learned(GuidingField::numberOfCells, false)
+{
+  for (int cell = 0; cell < GuidingField::numberOfCells; cell++)
+  {
+    float* cumulative =
+      &cumulativeProbability[cell * GuidingField::numberOfBins];
+
+    float total = 0.0f;
+    for (int bin = 0; bin < GuidingField::numberOfBins; bin++)
+    {
+      total += field.radianceSums[cell * GuidingField::numberOfBins + bin]
+               .load(std::memory_order_relaxed);
+      cumulative[bin] = total;
+    }
+
+    if (total <= 0.0f) continue;
+
+    learned[cell] = true;
+    for (int bin = 0; bin < GuidingField::numberOfBins; bin++)
+    {
+      cumulative[bin] /= total;
+    }
+  }
+}
+
+Vector3 GuidingDistribution::Sample(const int cell,
+                                    MonteCarloUnit& monteCarloUnit) const
+{
+  // Pick a bin with the learned probabilities
+  const float* begin =
+    &cumulativeProbability[cell * GuidingField::numberOfBins];
+  const float* end = begin + GuidingField::numberOfBins;
+  const int bin = std::min<int>(GuidingField::numberOfBins - 1,
+    static_cast<int>(std::upper_bound(begin, end, monteCarloUnit.GetUnit())
+                     - begin));
+
+  // Then pick a direction uniformly inside the bin
+  const int bz = bin / GuidingField::binsPhi;
+  const int bphi = bin % GuidingField::binsPhi;
+  const float z = ((bz + monteCarloUnit.GetUnit())
+                   / GuidingField::binsZ) * 2.0f - 1.0f;
+  const float phi = (((bphi + monteCarloUnit.GetUnit())
+                      / GuidingField::binsPhi) * 2.0f - 1.0f)
+                  * static_cast<float>(pi);
+  const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+
+  return MakeVector3(FastMath::Cos(phi) * r, FastMath::Sin(phi) * r, z);
+}
+
+float GuidingDistribution::GetProbability(const int cell,
+                                          const Vector3 direction) const
+{
+  const int bin = GuidingField::GetBin(direction);
+  const float* cumulative =
+    &cumulativeProbability[cell * GuidingField::numberOfBins];
+  const float probability = bin == 0
+                          ? cumulative[0]
+                          : cumulative[bin] - cumulative[bin - 1];
+
+  // All bins cover the same solid angle
+  const float binSolidAngle = static_cast<float>(pi) * 4.0f
+                            / GuidingField::numberOfBins;
+  return probability / binSolidAngle;
+}
@@ -0,0 +1,110 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  class MonteCarloUnit;
+
+  /// Learns the light arriving at every part of the scene from the paths
+  /// that were traced. Space is divided into voxels, which are hashed
+  /// into a fixed number of cells, and the sphere of directions of every
+  /// cell is divided into bins of equal solid angle. All trace units
+  /// record into the same field concurrently, without locks.
+  class GuidingField
+  {
+    public:
+
+      /// The number of cells that voxels are hashed into.
+      static const int numberOfCells = 1 << 14;
+
+      /// The number of bins along the z-axis (of equal height, so of
+      /// equal area on the sphere).
+      static const int binsZ = 8;
+
+      /// The number of bins around the z-axis.
+      static const int binsPhi = 8;
+
+      /// The number of direction bins per cell.
+      static const int numberOfBins = binsZ * binsPhi;
+
+      /// The width of a voxel (in scene units).
+      static const float voxelSize;
+
+      /// Creates an empty field.
+      GuidingField();
+
+      /// Records that the specified radiance arrived at the position
+      /// from the direction, which was sampled with the specified
+      /// probability density. This method is thread-safe.
+      void Record(const Vector3 position, const Vector3 direction,
+                  const float radiance, const float probability);
+
+      /// Returns the cell that the voxel containing the position
+      /// hashes to.
+      static int GetCell(const Vector3 position);
+
+      /// Returns the direction bin that contains the direction.
+      static int GetBin(const Vector3 direction);
+
+    private:
+
+      /// The sum of the recorded radiance divided by probability, per
+      /// bin, per cell.
+      std::vector<std::atomic<float>> radianceSums;
+
+      friend class GuidingDistribution;
+  };
+
+  /// A snapshot of the field, from which directions can be sampled
+  /// proportional to the learned incident radiance.
+  class GuidingDistribution
+  {
+    public:
+
+      /// Constructs a distribution that never guides.
+      GuidingDistribution();
+
+      /// Constructs a distribution from what the field has learned.
+      GuidingDistribution(const GuidingField& field);
+
+      /// Returns whether anything was learned about the cell.
+      inline bool HasLearned(const int cell) const
+      { return !cumulativeProbability.empty() && learned[cell]; }
+
+      /// Picks a direction proportional to the learned radiance of the
+      /// cell, which must have learned something.
+      Vector3 Sample(const int cell, MonteCarloUnit& monteCarloUnit) const;
+
+      /// Returns the probability density (per unit solid angle) with
+      /// which Sample would pick the direction.
+      float GetProbability(const int cell, const Vector3 direction) const;
+
+    private:
+
+      /// The cumulative probability of all bins up to and including the
+      /// bin at the index, per cell.
+      std::vector<float> cumulativeProbability;
+
+      /// Whether the cell has learned anything.
+      std::vector<bool> learned;
+  };
+}
@@ -0,0 +1,83 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace Luculentus
+{
+  /// Converts the number to an IEEE 754 half-precision float, rounding
+  /// to the nearest representable value. Half floats have 11 bits of
+  /// precision, so the relative error is at most 2^-11 for values
+  /// from 6.1e-5 up to 65504. Values beyond that range are clamped to
+  /// it rather than becoming infinite, smaller values lose precision.
+  inline uint16_t FloatToHalf(const float value)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    // Too large (or infinite, or not a number)
+    if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7bffu);
+
+    // Too small for a normal half, store it as a subnormal one
+    if (exponent <= 0)
+    {
+      if (exponent < -10) return static_cast<uint16_t>(sign);
+      mantissa |= 0x800000u;
+      const int shift = 14 - exponent;
+      uint32_t half = mantissa >> shift;
+      if ((mantissa >> (shift - 1)) & 1u) half++;
+      return static_cast<uint16_t>(sign | half);
+    }
+
+    // Rounding up may carry into the exponent, which is exactly right,
+    // unless it carries into infinity
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) half++;
+    if (half >= 0x7c00u) half = 0x7bffu;
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  /// Converts an IEEE 754 half-precision float to a float, exactly.
+  inline float HalfToFloat(const uint16_t half)
+  {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1fu;
+    const uint32_t mantissa = half & 0x3ffu;
+
+    // Subnormal halves are normal floats, but it is easier to scale
+    if (exponent == 0)
+    {
+      const float value = std::ldexp(static_cast<float>(mantissa), -24);
+      return sign ? -value : value;
+    }
+
+    const uint32_t bits = exponent == 31
+                        ? sign | 0x7f800000u | (mantissa << 13)
+                        : sign | ((exponent - 15 + 127) << 23)
+                               | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+}
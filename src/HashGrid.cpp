@@ -0,0 +1,87 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "HashGrid.h"
+
+#include <algorithm>
+#include "SpatialHash.h"
+
+using namespace Luculentus;
+
+void HashGrid::Build(const std::vector<Vector3>& points, const float r)
+{
+  radius = r;
+  radiusSquared = r * r;
+  cellSize = r * 2.0f;
+
+  bucketEnds.assign(points.size(), 0);
+  sortedPoints.resize(points.size());
+  indices.resize(points.size());
+
+  if (points.empty()) return;
+
+  // Find the bounding box of the points
+  minimum = maximum = points[0];
+  for (auto& p : points)
+  {
+    minimum.x = std::min(minimum.x, p.x);
+    minimum.y = std::min(minimum.y, p.y);
+    minimum.z = std::min(minimum.z, p.z);
+    maximum.x = std::max(maximum.x, p.x);
+    maximum.y = std::max(maximum.y, p.y);
+    maximum.z = std::max(maximum.z, p.z);
+  }
+
+  // Count the number of points in every bucket
+  std::vector<int> buckets(points.size());
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    const Vector3 d = (points[i] - minimum) * (1.0f / cellSize);
+    buckets[i] = GetBucket(static_cast<int>(std::floor(d.x)),
+                           static_cast<int>(std::floor(d.y)),
+                           static_cast<int>(std::floor(d.z)));
+    bucketEnds[buckets[i]]++;
+  }
+
+  // Then the ends follow from the running sum of the counts
+  int end = 0;
+  for (auto& bucketEnd : bucketEnds)
+  {
+    end += bucketEnd;
+    bucketEnd = end;
+  }
+
+  // And every point can be put in place, filling the buckets from the
+  // back, so the ends are the starts afterwards; this is corrected below
+  for (int i = static_cast<int>(points.size()) - 1; i >= 0; i--)
+  {
+    const int k = --bucketEnds[buckets[i]];
+    sortedPoints[k] = points[i];
+    indices[k] = i;
+  }
+
+  // The array now contains the starts, shift it to contain the ends
+  for (size_t i = 0; i + 1 < bucketEnds.size(); i++)
+  {
+    bucketEnds[i] = bucketEnds[i + 1];
+  }
+  bucketEnds.back() = static_cast<int>(points.size());
+}
+
+int HashGrid::GetBucket(const int x, const int y, const int z) const
+{
+  return static_cast<int>(HashCell(x, y, z) % bucketEnds.size());
+}
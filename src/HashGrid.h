@@ -0,0 +1,115 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  /// Finds all points within a fixed radius of a query position. The
+  /// points are bucketed into cells with the size of the diameter, and
+  /// the cells are hashed into a table with as many buckets as points.
+  class HashGrid
+  {
+    public:
+
+      /// Rebuilds the grid for the specified points and lookup radius.
+      void Build(const std::vector<Vector3>& points, const float radius);
+
+      /// Calls the callback with the index (into the points passed to
+      /// Build) of every point within the radius of the position.
+      template <typename Callback>
+      void Query(const Vector3 position, Callback callback) const;
+
+    private:
+
+      /// The lookup radius, and its square.
+      float radius, radiusSquared;
+
+      /// The width of a cell, which is twice the radius.
+      float cellSize;
+
+      /// The minimum corner of the bounding box of the points.
+      Vector3 minimum;
+
+      /// The maximum corner of the bounding box of the points.
+      Vector3 maximum;
+
+      /// The index into the sorted points one past the last point in
+      /// every bucket, the first point is at the end of the previous.
+      std::vector<int> bucketEnds;
+
+      /// The points, sorted by bucket.
+      std::vector<Vector3> sortedPoints;
+
+      /// The original index of every sorted point.
+      std::vector<int> indices;
+
+      /// Returns the bucket of the cell with the specified coordinates.
+      int GetBucket(const int x, const int y, const int z) const;
+  };
+
+  template <typename Callback>
+  void HashGrid::Query(const Vector3 position, Callback callback) const
+  {
+    if (bucketEnds.empty()) return;
+
+    // The point must lie in the bounding box (extended by the radius)
+    // for there to be anything nearby.
+    if (position.x < minimum.x - radius || position.x > maximum.x + radius
+     || position.y < minimum.y - radius || position.y > maximum.y + radius
+     || position.z < minimum.z - radius || position.z > maximum.z + radius)
+      return;
+
+    // The sphere around the position overlaps at most eight cells: the
+    // one that contains it, and the neighbours on the nearest sides.
+    const Vector3 d = (position - minimum) * (1.0f / cellSize);
+    const int cx = static_cast<int>(std::floor(d.x));
+    const int cy = static_cast<int>(std::floor(d.y));
+    const int cz = static_cast<int>(std::floor(d.z));
+    const int nx = d.x - cx < 0.5f ? cx - 1 : cx + 1;
+    const int ny = d.y - cy < 0.5f ? cy - 1 : cy + 1;
+    const int nz = d.z - cz < 0.5f ? cz - 1 : cz + 1;
+
+    // Different cells can hash to the same bucket, which must then be
+    // visited only once.
+    int visited[8];
+    int numberOfVisited = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+      const int bucket = GetBucket(i & 1 ? nx : cx,
+                                   i & 2 ? ny : cy,
+                                   i & 4 ? nz : cz);
+
+      bool seen = false;
+      for (int j = 0; j < numberOfVisited; j++)
+        seen = seen || visited[j] == bucket;
+      if (seen) continue;
+      visited[numberOfVisited++] = bucket;
+
+      const int begin = bucket == 0 ? 0 : bucketEnds[bucket - 1];
+      for (int k = begin; k < bucketEnds[bucket]; k++)
+      {
+        if ((sortedPoints[k] - position).MagnitudeSquared() <= radiusSquared)
+          callback(indices[k]);
+      }
+    }
+  }
+}
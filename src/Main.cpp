@@ -16,6 +16,7 @@
 
 #include "UserInterface.h"
 #include "Raytracer.h"
+#include "Settings.h"
 
 using namespace Luculentus;
 
@@ -24,8 +25,15 @@ int main(int argc, char** argv)
   // Build the UI to display the rendered image.
   UserInterface ui(argc, argv);
 
+  // Read options such as stopping criteria from the command line.
+  Settings settings = ParseSettings(argc, argv);
+
+  // A film that was saved before only needs to be tonemapped again.
+  if (!settings.filmInputFile.empty())
+    return Raytracer::Retonemap(settings) ? 0 : 1;
+
   // Create the path tracer itself.
-  Raytracer raytracer(ui);
+  Raytracer raytracer(ui, settings);
 
   // Display a black image to start with.
   std::vector<std::uint8_t> blackBuffer(1280 * 720 * 3, 0);
@@ -34,7 +42,8 @@ int main(int argc, char** argv)
   // Begin rendering with all threads.
   raytracer.StartRendering();
 
-  // Run the UI event loop, it returns when the window is closed.
+  // Run the UI event loop, it returns when the window is closed, or
+  // when a stopping criterion is met.
   ui.Run();
 
   // And when the UI is closed, stop rendering.
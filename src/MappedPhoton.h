@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include "Half.h"
+
 namespace Luculentus
 {
   struct MappedPhoton
@@ -30,4 +34,52 @@ namespace Luculentus
     /// The wavelength of the simulated photon (in nm).
     float wavelength;
   };
+
+  /// A MappedPhoton in half the size. The screen position is quantised
+  /// to 1/65535 of the width and height of the screen (a fraction of a
+  /// pixel for any sensible resolution), the wavelength to 1/65535 of
+  /// the visible spectrum, and the probability is a half float.
+  struct PackedPhoton
+  {
+    /// Screen position, as a fraction of the width and height.
+    uint16_t u, v;
+
+    /// The wavelength, as a fraction of the visible spectrum.
+    uint16_t wavelength;
+
+    /// The probability, as a half float.
+    uint16_t probability;
+  };
+
+  /// Quantises a number in the range 0 .. 1 to 16 bits.
+  inline uint16_t QuantiseUnit(const float x)
+  {
+    const float clamped = std::max(0.0f, std::min(1.0f, x));
+    return static_cast<uint16_t>(clamped * 65535.0f + 0.5f);
+  }
+
+  /// Packs the photon, for an image with the specified aspect ratio.
+  /// Photons outside the screen are moved onto its edge.
+  inline PackedPhoton Pack(const MappedPhoton photon, const float aspectRatio)
+  {
+    PackedPhoton packed;
+    packed.u = QuantiseUnit(photon.x * 0.5f + 0.5f);
+    packed.v = QuantiseUnit(photon.y * aspectRatio * 0.5f + 0.5f);
+    packed.wavelength = QuantiseUnit((photon.wavelength - 380.0f) / 400.0f);
+    packed.probability = FloatToHalf(photon.probability);
+    return packed;
+  }
+
+  /// Unpacks the photon, for an image with the specified aspect ratio.
+  inline MappedPhoton Unpack(const PackedPhoton packed,
+                             const float aspectRatio)
+  {
+    const float scale = 1.0f / 65535.0f;
+    MappedPhoton photon;
+    photon.x = packed.u * scale * 2.0f - 1.0f;
+    photon.y = (packed.v * scale * 2.0f - 1.0f) / aspectRatio;
+    photon.wavelength = 380.0f + packed.wavelength * scale * 400.0f;
+    photon.probability = HalfToFloat(packed.probability);
+    return photon;
+  }
 }
@@ -19,9 +19,23 @@
 #include <algorithm>
 #include "MonteCarloUnit.h"
 #include "Constants.h"
+#include "FastMath.h"
 
 using namespace Luculentus;
 
+bool Material::IsDiffuse() const
+{
+  return false;
+}
+
+float Material::GetReflectance(const float) const
+{
+  // Only meaningful for diffuse materials
+  return 0.0f;
+}
+
+// --------------------
+
 Ray ClayMaterial::GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const
@@ -47,6 +61,16 @@ Ray ClayMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+bool ClayMaterial::IsDiffuse() const
+{
+  return true;
+}
+
+float ClayMaterial::GetReflectance(const float) const
+{
+  return 1.0f;
+}
+
 // --------------------
 
 DiffuseGreyMaterial::DiffuseGreyMaterial(const float refl)
@@ -61,6 +85,11 @@ Ray DiffuseGreyMaterial::GetNewRay(const Ray incomingRay,
   return newRay;
 }
 
+float DiffuseGreyMaterial::GetReflectance(const float) const
+{
+  return reflectance;
+}
+
 // --------------------
 
 DiffuseColouredMaterial::DiffuseColouredMaterial(const float refl,
@@ -68,21 +97,30 @@ DiffuseColouredMaterial::DiffuseColouredMaterial(const float refl,
                                                  const float dev)
   : DiffuseGreyMaterial(refl)
   , wavelength(wavel)
-  , deviation(dev) { }
+  , deviation(dev)
+  , reflectanceCurve([=](const float w)
+    {
+      float p = (wavel - w) / dev;
+      float q = std::exp(-0.5f * p * p);
+
+      return refl * q;
+    }) { }
 
 Ray DiffuseColouredMaterial::GetNewRay(const Ray incomingRay,
                                        const Intersection intersection,
                                        MonteCarloUnit& monteCarloUnit) const
 {
-  float p = (wavelength - incomingRay.wavelength) / deviation;
-  float q = std::exp(-0.5f * p * p);
-  
-  Ray newRay = DiffuseGreyMaterial::GetNewRay(incomingRay,
+  Ray newRay = ClayMaterial::GetNewRay(incomingRay,
     intersection, monteCarloUnit);
-  newRay.probability *= q;
+  newRay.probability *= reflectanceCurve(incomingRay.wavelength);
   return newRay;
 }
 
+float DiffuseColouredMaterial::GetReflectance(const float wavel) const
+{
+  return reflectanceCurve(wavel);
+}
+
 // --------------------
 
 Ray PerfectMirrorMaterial::GetNewRay(const Ray incomingRay,
@@ -251,7 +289,15 @@ Ray RefractiveMaterial::GetNewRay(const Ray incomingRay,
 
 // --------------------
 
+Bk7GlassMaterial::Bk7GlassMaterial()
+  : indexCurve(GetSellmeierIndex) { }
+
 float Bk7GlassMaterial::GetIndexOfRefraction(const float wavelength) const
+{
+  return indexCurve(wavelength);
+}
+
+float Bk7GlassMaterial::GetSellmeierIndex(const float wavelength)
 {
   // See http://refractiveindex.info/?group=GLASSES&material=BK7
 
@@ -267,9 +313,16 @@ float Bk7GlassMaterial::GetIndexOfRefraction(const float wavelength) const
 
 // --------------------
 
+Sf10GlassMaterial::Sf10GlassMaterial()
+  : indexCurve(GetSellmeierIndex) { }
+
 float Sf10GlassMaterial::GetIndexOfRefraction(const float wavelength) const
 {
+  return indexCurve(wavelength);
+}
 
+float Sf10GlassMaterial::GetSellmeierIndex(const float wavelength)
+{
   // See http://refractiveindex.info/?group=GLASSES&material=SF11
 
   // Square and convert nanometer to micrometer.
@@ -318,9 +371,10 @@ Ray SoapBubbleMaterial::GetNewRay(const Ray incomingRay,
     Dot(newRay.direction, intersection.normal)));
   const float cosTheta = std::min(0.999f, std::max(-0.999f,
     Dot(newRay.direction, intersection.tangent)));
-  newRay.probability = std::cos(phaseShift - std::acos(cosPhi) * 3.0f
-                                - std::acos(cosTheta) * 2.0f
-                                + (float)pi * 0.5f) * 0.1f + 0.9f;
+  newRay.probability = FastMath::Cos(phaseShift
+                                     - FastMath::Acos(cosPhi) * 3.0f
+                                     - FastMath::Acos(cosTheta) * 2.0f
+                                     + (float)pi * 0.5f) * 0.1f + 0.9f;
 
   newRay.wavelength = incomingRay.wavelength;
   newRay.origin = intersection.position;
@@ -366,8 +420,10 @@ Ray IridescentMaterial::GetNewRay(const Ray incomingRay,
     Dot(newRay.direction, intersection.normal)));
   const float cosTheta = std::min(0.999f, std::max(-0.999f,
     Dot(newRay.direction, intersection.tangent)));
-  newRay.probability = std::cos(phaseShift + std::acos(cosPhi) * 3.0f
-                            - std::acos(cosTheta) * 2.0f) * 0.5f + 0.5f;
+  newRay.probability = FastMath::Cos(phaseShift
+                                     + FastMath::Acos(cosPhi) * 3.0f
+                                     - FastMath::Acos(cosTheta) * 2.0f)
+                     * 0.5f + 0.5f;
 
   newRay.wavelength = incomingRay.wavelength;
   newRay.origin = intersection.position;
@@ -18,6 +18,7 @@
 
 #include "Ray.h"
 #include "Intersection.h"
+#include "SpectralCurve.h"
 
 namespace Luculentus
 {
@@ -32,6 +33,15 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const = 0;
+
+      /// Returns whether the material scatters light with a Lambertian
+      /// distribution, so it can be evaluated for any pair of directions.
+      /// Other materials can only be sampled with GetNewRay.
+      virtual bool IsDiffuse() const;
+
+      /// Returns the fraction of the light at the specified wavelength
+      /// that a diffuse material reflects.
+      virtual float GetReflectance(const float wavelength) const;
   };
 
   /// A perfectly diffuse, perfectly reflecting all wavelengths, material.
@@ -42,6 +52,10 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual bool IsDiffuse() const;
+
+      virtual float GetReflectance(const float wavelength) const;
   };
 
   /// Same as clay, but not perfectly white; it absorbes energy.
@@ -59,6 +73,8 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetReflectance(const float wavelength) const;
   };
 
   /// Reflects light of a certain wavelength better than others,
@@ -78,6 +94,13 @@ namespace Luculentus
       virtual Ray GetNewRay(const Ray incomingRay,
                             const Intersection intersection,
                             MonteCarloUnit& monteCarloUnit) const;
+
+      virtual float GetReflectance(const float wavelength) const;
+
+    private:
+
+      /// The reflectance at every wavelength, sampled once.
+      SpectralCurve reflectanceCurve;
   };
 
   /// Reflects all light perfectly along the same (but opposite) angle.
@@ -140,14 +163,34 @@ namespace Luculentus
   {
     public:
 
+      Bk7GlassMaterial();
+
       virtual float GetIndexOfRefraction(const float wavelength) const;
+
+    private:
+
+      /// The index of refraction at every wavelength, sampled once.
+      SpectralCurve indexCurve;
+
+      /// Evaluates the Sellmeier equation of the glass.
+      static float GetSellmeierIndex(const float wavelength);
   };
 
   class Sf10GlassMaterial : public RefractiveMaterial
   {
     public:
 
+      Sf10GlassMaterial();
+
       virtual float GetIndexOfRefraction(const float wavelength) const;
+
+    private:
+
+      /// The index of refraction at every wavelength, sampled once.
+      SpectralCurve indexCurve;
+
+      /// Evaluates the Sellmeier equation of the glass.
+      static float GetSellmeierIndex(const float wavelength);
   };
 
   /// A not physically accurate, but still aesthetically pleasant soap
@@ -0,0 +1,58 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Quaternion.h"
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  /// A 3x3 matrix, stored as its three columns.
+  struct Matrix3
+  {
+    Vector3 x, y, z;
+  };
+
+  /// Returns the matrix that rotates vectors like the (unit) quaternion.
+  inline Matrix3 MakeRotationMatrix(const Quaternion q)
+  {
+    // The columns are the images of the axes, written out so that
+    // only multiply-adds remain
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    Matrix3 m =
+    {
+      { 1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy) },
+      { 2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx) },
+      { 2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy) }
+    };
+    return m;
+  }
+
+  inline Vector3 operator*(const Matrix3& m, const Vector3 v)
+  {
+    return m.x * v.x + m.y * v.y + m.z * v.z;
+  }
+
+  /// Transforms the vector with the transpose of the matrix, which for
+  /// a rotation is the inverse rotation.
+  inline Vector3 TransposeMultiply(const Matrix3& m, const Vector3 v)
+  {
+    return MakeVector3(Dot(m.x, v), Dot(m.y, v), Dot(m.z, v));
+  }
+}
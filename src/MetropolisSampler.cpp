@@ -0,0 +1,110 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "MetropolisSampler.h"
+
+#include <cmath>
+
+using namespace Luculentus;
+
+const float MetropolisSampler::largeStepProbability = 0.3f;
+const float MetropolisSampler::smallStepSize = 0.01f;
+
+MetropolisSampler::MetropolisSampler(const unsigned long seed)
+  : unitDistribution(0.0f, 1.0f)
+  , normalDistribution(0.0f, 1.0f)
+  , sampleIndex(0)
+  , iteration(0)
+  , lastLargeStep(0)
+  , largeStep(true)
+{
+  randomEngine.seed(seed);
+}
+
+void MetropolisSampler::StartIteration(const bool forceLargeStep)
+{
+  iteration++;
+  sampleIndex = 0;
+  largeStep = forceLargeStep
+           || unitDistribution(randomEngine) < largeStepProbability;
+}
+
+float MetropolisSampler::Next()
+{
+  // Paths can be longer than any path before, extend the vector then
+  if (sampleIndex >= samples.size())
+  {
+    PrimarySample sample = { 0.0f, -1, 0.0f, -1 };
+    samples.push_back(sample);
+  }
+
+  PrimarySample& sample = samples[sampleIndex++];
+  Update(sample);
+  return sample.value;
+}
+
+void MetropolisSampler::Update(PrimarySample& sample)
+{
+  // A number that was not used since the last accepted large step
+  // must have been replaced by that large step
+  if (sample.modified < lastLargeStep)
+  {
+    sample.value = unitDistribution(randomEngine);
+    sample.modified = lastLargeStep;
+  }
+
+  if (sample.modified == iteration) return;
+
+  sample.valueBackup = sample.value;
+  sample.modifiedBackup = sample.modified;
+
+  if (largeStep)
+  {
+    sample.value = unitDistribution(randomEngine);
+  }
+  else
+  {
+    // The small steps that were skipped while the number was not used
+    // add up to a single step with a larger deviation
+    const float steps = static_cast<float>(iteration - sample.modified);
+    sample.value += normalDistribution(randomEngine)
+                  * smallStepSize * std::sqrt(steps);
+
+    // Wrap around, so the mutation stays symmetric
+    sample.value -= std::floor(sample.value);
+  }
+
+  sample.modified = iteration;
+}
+
+void MetropolisSampler::Accept()
+{
+  if (largeStep) lastLargeStep = iteration;
+}
+
+void MetropolisSampler::Reject()
+{
+  for (auto& sample : samples)
+  {
+    if (sample.modified == iteration)
+    {
+      sample.value = sample.valueBackup;
+      sample.modified = sample.modifiedBackup;
+    }
+  }
+
+  iteration--;
+}
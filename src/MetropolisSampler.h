@@ -0,0 +1,108 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <random>
+#include <vector>
+
+namespace Luculentus
+{
+  /// The state of a Markov chain in primary sample space: the vector of
+  /// random numbers that a path was rendered with. Every iteration
+  /// proposes a mutation of the vector, which is then accepted or
+  /// rejected. Numbers are mutated lazily, when they are used, so paths
+  /// of any length can be mutated ("A Simple and Robust Mutation
+  /// Strategy for the Metropolis Light Transport Algorithm", Kelemen et
+  /// al., 2002).
+  class MetropolisSampler
+  {
+    public:
+
+      /// The probability that an iteration replaces all numbers with new
+      /// independent ones, rather than perturbing them.
+      static const float largeStepProbability;
+
+      /// The standard deviation of a small step perturbation.
+      static const float smallStepSize;
+
+      /// Creates a sampler with its own random generator, seeded with
+      /// the specified seed.
+      MetropolisSampler(const unsigned long seed);
+
+      /// Starts proposing a new mutation. When largeStep is true, the
+      /// mutation is a large step regardless of the probability.
+      void StartIteration(const bool forceLargeStep);
+
+      /// Returns whether the current proposal is a large step.
+      inline bool IsLargeStep() const { return largeStep; }
+
+      /// Returns the next number of the proposed vector,
+      /// in the range 0 .. 1.
+      float Next();
+
+      /// Makes the proposal the current state of the chain.
+      void Accept();
+
+      /// Discards the proposal, restoring the current state.
+      void Reject();
+
+    private:
+
+      /// One number of the primary sample vector.
+      struct PrimarySample
+      {
+        /// The number itself, in the range 0 .. 1.
+        float value;
+
+        /// The iteration in which the number was last changed.
+        long long modified;
+
+        /// The value and modification iteration before the proposal,
+        /// to restore them on rejection.
+        float valueBackup;
+        long long modifiedBackup;
+      };
+
+      /// The generator of the random numbers used for mutation.
+      std::mt19937 randomEngine;
+
+      /// Uniform distribution in the range 0 .. 1.
+      std::uniform_real_distribution<float> unitDistribution;
+
+      /// Standard normal distribution, for small steps.
+      std::normal_distribution<float> normalDistribution;
+
+      /// The primary sample vector, as long as the longest path so far.
+      std::vector<PrimarySample> samples;
+
+      /// The index of the next number that Next will return.
+      size_t sampleIndex;
+
+      /// The index of the current iteration.
+      long long iteration;
+
+      /// The index of the last large step that was accepted.
+      long long lastLargeStep;
+
+      /// Whether the current proposal is a large step.
+      bool largeStep;
+
+      /// Applies all the mutations that the number missed since it was
+      /// last used.
+      void Update(PrimarySample& sample);
+  };
+}
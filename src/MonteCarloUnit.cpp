@@ -17,6 +17,8 @@
 #include "MonteCarloUnit.h"
 
 #include "Constants.h"
+#include "FastMath.h"
+#include "MetropolisSampler.h"
 
 using namespace Luculentus;
 
@@ -28,6 +30,7 @@ MonteCarloUnit::MonteCarloUnit(const unsigned long randomSeed)
   , latitudeDistribution(static_cast<float>(-pi * 0.5f),
       static_cast<float>(pi * 0.5f))
   , wavelengthDistribution(380.0f, 780.0f)
+  , metropolisSampler(nullptr)
 {
   randomEngine.seed(randomSeed);
 }
@@ -43,8 +46,8 @@ Vector3 MonteCarloUnit::GetCosineDistributedHemisphereVector()
   // This distribution is cosine-weighted.
   Vector3 v =
   {
-    std::cos(phi) * r,
-    std::sin(phi) * r,
+    FastMath::Cos(phi) * r,
+    FastMath::Sin(phi) * r,
     std::sqrt(1.0f - rq),
   };
 
@@ -60,10 +63,15 @@ Vector3 MonteCarloUnit::GetHemisphereVector()
   // Calculate the direction based on the polar coordinates.
   Vector3 v =
   {
-    std::cos(phi) * std::sin(theta),
-    std::sin(phi) * std::sin(theta),
-    std::cos(theta),
+    FastMath::Cos(phi) * FastMath::Sin(theta),
+    FastMath::Sin(phi) * FastMath::Sin(theta),
+    FastMath::Cos(theta),
   };
 
   return v;
 }
+
+float MonteCarloUnit::GetPrimarySample()
+{
+  return metropolisSampler->Next();
+}
@@ -21,6 +21,8 @@
 
 namespace Luculentus
 {
+  class MetropolisSampler;
+
   /// An entropy provider that can be kept per-thread.
   class MonteCarloUnit
   {
@@ -44,28 +46,47 @@ namespace Luculentus
       /// Uniform distribution in the range 380 .. 780.
       std::uniform_real_distribution<float> wavelengthDistribution;
 
+      /// When set, the numbers are taken from the Markov chain of the
+      /// sampler instead of from the random generator (not owned).
+      MetropolisSampler* metropolisSampler;
+
       /// Initializes a new entropy provider with the specified seed.
       MonteCarloUnit(const long unsigned int seed);
 
       /// Returns a random real in the range -1 .. 1.
       inline float GetBiUnit()
-      { return biUnitDistribution(randomEngine); }
+      {
+        if (metropolisSampler) return GetPrimarySample() * 2.0f - 1.0f;
+        return biUnitDistribution(randomEngine);
+      }
 
       /// Returns a random real in the range 0 .. 1.
       inline float GetUnit()
-      { return unitDistribution(randomEngine); }
+      {
+        if (metropolisSampler) return GetPrimarySample();
+        return unitDistribution(randomEngine);
+      }
 
       /// Returns a random real in the range 0 .. 2pi.
       inline float GetLongitude()
-      { return longitudeDistribution(randomEngine); }
+      {
+        if (metropolisSampler) return MapPrimarySample(longitudeDistribution);
+        return longitudeDistribution(randomEngine);
+      }
 
       /// Returns a random real in the range -pi/2 .. pi/2.
       inline float GetLatitude()
-      { return latitudeDistribution(randomEngine); }
+      {
+        if (metropolisSampler) return MapPrimarySample(latitudeDistribution);
+        return latitudeDistribution(randomEngine);
+      }
 
       /// Returns a random real in the range 380 .. 780.
       inline float GetWavelength()
-      { return wavelengthDistribution(randomEngine); }
+      {
+        if (metropolisSampler) return MapPrimarySample(wavelengthDistribution);
+        return wavelengthDistribution(randomEngine);
+      }
 
       /// Returns a random unit vector, pointing up along the z-axis,
       /// in the hemisphere bounded by the xy-plane, with a
@@ -76,5 +97,19 @@ namespace Luculentus
       /// in the hemisphere bounded by the xy-plane, with a uniform
       /// probability.
       Vector3 GetHemisphereVector();
+
+    private:
+
+      /// Returns the next number of the Markov chain.
+      float GetPrimarySample();
+
+      /// Maps the next number of the Markov chain onto the range of the
+      /// distribution.
+      inline float MapPrimarySample(
+        const std::uniform_real_distribution<float>& distribution)
+      {
+        return distribution.a()
+             + GetPrimarySample() * (distribution.b() - distribution.a());
+      }
   };
 }
@@ -0,0 +1,180 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "PhotonMapper.h"
+
+#include <algorithm>
+#include <cmath>
+#include "Constants.h"
+#include "MonteCarloUnit.h"
+#include "Scene.h"
+#include "TraceUnit.h"
+
+using namespace Luculentus;
+
+const int PhotonMapper::cameraPathsPerLightPath = 4;
+const float PhotonMapper::initialRadius = 0.3f;
+const float PhotonMapper::alpha = 0.75f;
+
+PhotonMapper::PhotonMapper(const Scene& scn)
+  : scene(scn)
+  , passes(0)
+  , radius(initialRadius)
+  , wavelength(0.0f)
+  , numberOfLightPaths(0)
+{
+
+}
+
+void PhotonMapper::TracePhotons(const float wavel, const int numberOfPaths,
+                                MonteCarloUnit& monteCarloUnit)
+{
+  // Every pass, the area of the lookup disk shrinks by a factor
+  // (i + alpha) / (i + 1), slow enough that the number of photons
+  // found still grows, but fast enough for the bias to vanish
+  if (passes > 0)
+  {
+    radius *= std::sqrt((passes + alpha) / (passes + 1.0f));
+  }
+  passes++;
+
+  wavelength = wavel;
+  numberOfLightPaths = std::max(1, numberOfPaths / cameraPathsPerLightPath);
+  photons.clear();
+  photonPositions.clear();
+
+  const float totalPower = scene.GetTotalPower(wavelength);
+
+  for (int i = 0; i < numberOfLightPaths; i++)
+  {
+    LightSample light;
+    if (!scene.SampleLight(wavelength, totalPower, monteCarloUnit, light))
+      continue;
+
+    // Emit the photon in a cosine-weighted direction, for which the
+    // cosine cancels against the probability
+    Ray ray;
+    ray.origin = light.position;
+    ray.direction = RotateTowards(
+      monteCarloUnit.GetCosineDistributedHemisphereVector(), light.normal);
+    ray.wavelength = wavelength;
+    float throughput = light.intensity * static_cast<float>(pi)
+                     / light.probability;
+    if (throughput <= 0.0f) continue;
+    const float emittedThroughput = throughput;
+
+    for (int depth = 0; ; depth++)
+    {
+      // Displace the origin slightly, so the ray won't intersect the
+      // point it starts from
+      ray.origin = ray.origin + ray.direction * 0.00001f;
+
+      Intersection intersection;
+      const Object* object = scene.Intersect(ray, intersection);
+
+      // Light that leaves the scene, or that hits a light source,
+      // does not reach the camera any more
+      if (!object || !object->material) break;
+
+      if (object->material->IsDiffuse())
+      {
+        Photon photon;
+        photon.incoming = ray.direction;
+        photon.throughput = throughput;
+        photons.push_back(photon);
+        photonPositions.push_back(intersection.position);
+      }
+
+      ray = object->material->GetNewRay(ray, intersection, monteCarloUnit);
+      throughput *= ray.probability;
+
+      // After a few bounces, play Russian roulette on the throughput,
+      // relative to the light that was emitted, like the light subpaths
+      // of the bidirectional tracer
+      if (depth + 1 >= TraceUnit::minimumDepth)
+      {
+        const float survivalChance = std::min(
+          TraceUnit::maximumSurvivalChance, throughput / emittedThroughput);
+        if (monteCarloUnit.GetUnit() >= survivalChance) break;
+        throughput /= survivalChance;
+      }
+    }
+  }
+
+  grid.Build(photonPositions, radius);
+}
+
+float PhotonMapper::Gather(const float x, const float y,
+                           MonteCarloUnit& monteCarloUnit) const
+{
+  // Get a camera at a random time, and a ray through the screen
+  const Camera camera = scene.GetCamera(monteCarloUnit.GetUnit());
+  Ray ray = camera.GetRay(x, y, wavelength, monteCarloUnit);
+
+  float intensity = 1.0f;
+
+  // Whatever happens along the path, its contribution cannot exceed
+  // its intensity times the intensity of the brightest light
+  const float maximumIntensity = scene.GetMaximumIntensity(wavelength);
+
+  for (int depth = 0; ; depth++)
+  {
+    Intersection intersection;
+    const Object* object = scene.Intersect(ray, intersection);
+    if (!object) return 0.0f;
+
+    // Light sources that are seen directly, or through specular
+    // surfaces, can not be found by photons
+    if (!object->material)
+    {
+      return intensity * object->emissiveMaterial->GetIntensity(wavelength);
+    }
+
+    // At the first diffuse surface, the path ends, and the photons
+    // nearby estimate the light that it reflects
+    if (object->material->IsDiffuse())
+    {
+      const float cosIn = Dot(ray.direction, intersection.normal);
+      float flux = 0.0f;
+
+      grid.Query(intersection.position, [&](const int i)
+      {
+        // Only photons that arrive at the visible side count
+        if (Dot(photons[i].incoming, intersection.normal) * cosIn > 0.0f)
+          flux += photons[i].throughput;
+      });
+
+      const float reflectance =
+        object->material->GetReflectance(wavelength) / static_cast<float>(pi);
+      const float area = static_cast<float>(pi) * radius * radius;
+
+      return intensity * reflectance * flux / (area * numberOfLightPaths);
+    }
+
+    ray = object->material->GetNewRay(ray, intersection, monteCarloUnit);
+    intensity *= ray.probability;
+    ray.origin = ray.origin + ray.direction * 0.00001f;
+
+    // Russian roulette on the throughput, like the path tracer
+    if (depth + 1 >= TraceUnit::minimumDepth)
+    {
+      const float survivalChance = std::min(
+        TraceUnit::maximumSurvivalChance, intensity * maximumIntensity);
+      if (monteCarloUnit.GetUnit() >= survivalChance) return 0.0f;
+      intensity /= survivalChance;
+    }
+  }
+}
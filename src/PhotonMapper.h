@@ -0,0 +1,103 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+#include "HashGrid.h"
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  class MonteCarloUnit;
+  class Scene;
+
+  /// Renders with progressive photon mapping: every pass, photons are
+  /// traced from the light sources and stored where they hit a diffuse
+  /// surface. Camera paths then estimate the light at their first
+  /// diffuse vertex from the photons nearby. The lookup radius shrinks
+  /// every pass, so the bias vanishes as more passes are averaged
+  /// ("Progressive Photon Mapping: A Probabilistic Approach", Knaus and
+  /// Zwicker, 2011). This finds paths through glass and onto a diffuse
+  /// surface that no other method can connect.
+  class PhotonMapper
+  {
+    public:
+
+      /// The scene that will be rendered.
+      const Scene& scene;
+
+      /// The number of camera paths that share one path traced from the
+      /// light sources.
+      static const int cameraPathsPerLightPath;
+
+      /// The lookup radius of the first pass (in scene units).
+      static const float initialRadius;
+
+      /// Controls how fast the radius shrinks, between 0 and 1. Lower
+      /// values remove bias faster, at the cost of more noise.
+      static const float alpha;
+
+      /// Creates a photon mapper for the specified scene.
+      PhotonMapper(const Scene& scn);
+
+      /// Starts a new pass at the specified wavelength: traces photons
+      /// from the light sources for the specified number of camera
+      /// paths, and shrinks the lookup radius.
+      void TracePhotons(const float wavelength, const int numberOfPaths,
+                        MonteCarloUnit& monteCarloUnit);
+
+      /// Returns the contribution of a camera ray through the specified
+      /// screen position, at the wavelength of the current pass.
+      float Gather(const float x, const float y,
+                   MonteCarloUnit& monteCarloUnit) const;
+
+    private:
+
+      /// A photon that hit a diffuse surface.
+      struct Photon
+      {
+        /// The direction in which the photon arrived.
+        Vector3 incoming;
+
+        /// The flux carried by the photon, before dividing by the
+        /// number of light paths.
+        float throughput;
+      };
+
+      /// The photons of the current pass.
+      std::vector<Photon> photons;
+
+      /// The positions of the photons, in the same order.
+      std::vector<Vector3> photonPositions;
+
+      /// The grid used to find photons near a position.
+      HashGrid grid;
+
+      /// The number of passes traced so far.
+      int passes;
+
+      /// The lookup radius of the current pass.
+      float radius;
+
+      /// The wavelength of the current pass.
+      float wavelength;
+
+      /// The number of paths traced from the light sources in the
+      /// current pass.
+      int numberOfLightPaths;
+  };
+}
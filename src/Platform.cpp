@@ -0,0 +1,136 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace Luculentus;
+
+size_t Luculentus::GetCacheSize(const int level)
+{
+  // Typical sizes for recent processors
+  const size_t defaultSize = level == 1 ? 32 * 1024
+                           : level == 2 ? 256 * 1024
+                           : 8 * 1024 * 1024;
+
+  #ifdef _WIN32
+  DWORD length = 0;
+  GetLogicalProcessorInformation(nullptr, &length);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> information(
+    length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+  if (information.empty()
+   || !GetLogicalProcessorInformation(&information[0], &length))
+    return defaultSize;
+
+  for (auto& info : information)
+  {
+    if (info.Relationship == RelationCache && info.Cache.Level == level
+        && info.Cache.Type != CacheInstruction)
+      return info.Cache.Size;
+  }
+  #elif defined(_SC_LEVEL1_DCACHE_SIZE)
+  const long size = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE
+                          : level == 2 ? _SC_LEVEL2_CACHE_SIZE
+                          : _SC_LEVEL3_CACHE_SIZE);
+  if (size > 0) return static_cast<size_t>(size);
+  #endif
+
+  return defaultSize;
+}
+
+size_t Luculentus::GetMemorySize()
+{
+  size_t size = 0;
+
+  #ifdef _WIN32
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (GlobalMemoryStatusEx(&status))
+    size = static_cast<size_t>(status.ullTotalPhys);
+  #else
+  #ifdef _SC_PHYS_PAGES
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long pageSize = sysconf(_SC_PAGESIZE);
+  if (pages > 0 && pageSize > 0)
+    size = static_cast<size_t>(pages) * static_cast<size_t>(pageSize);
+  #endif
+
+  // A container can be limited to less than that (the limit reads "max"
+  // if there is none, which does not parse as a number)
+  const char* const limitFiles[] =
+  {
+    "/sys/fs/cgroup/memory.max",
+    "/sys/fs/cgroup/memory/memory.limit_in_bytes"
+  };
+  for (auto fileName : limitFiles)
+  {
+    std::ifstream file(fileName);
+    unsigned long long limit = 0;
+    if (file >> limit && limit > 0 && (size == 0 || limit < size))
+      size = static_cast<size_t>(limit);
+  }
+  #endif
+
+  return size;
+}
+
+void Luculentus::AdviseHugePages(void* data, const size_t size)
+{
+  #ifdef MADV_HUGEPAGE
+  // Only whole huge pages can be advised
+  const std::uintptr_t hugePageSize = 2 * 1024 * 1024;
+  const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(data);
+  const std::uintptr_t begin = (address + hugePageSize - 1)
+                             & ~(hugePageSize - 1);
+  const std::uintptr_t end = (address + size) & ~(hugePageSize - 1);
+  if (end > begin)
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+  #else
+  (void)data;
+  (void)size;
+  #endif
+}
+
+void Luculentus::PinThread(const int processor)
+{
+  #ifdef _WIN32
+  const int processors = 8 * sizeof(DWORD_PTR);
+  SetThreadAffinityMask(GetCurrentThread(),
+                        static_cast<DWORD_PTR>(1) << (processor % processors));
+  #elif defined(CPU_SET)
+  const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  if (processors <= 0) return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(processor % processors, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  #else
+  (void)processor;
+  #endif
+}
@@ -0,0 +1,58 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Luculentus
+{
+  /// Returns the size (in bytes) of the data cache of the specified
+  /// level (1, 2 or 3), or a typical size if the operating system does
+  /// not tell.
+  size_t GetCacheSize(const int level);
+
+  /// Returns the physical memory (in bytes) that the process may use,
+  /// or zero if the operating system does not tell. On Linux, the limit
+  /// of the control group (of a container, for instance) counts too.
+  size_t GetMemorySize();
+
+  /// Asks the operating system to back the memory with huge pages
+  /// (2 MB), which saves translation lookaside buffer misses when the
+  /// memory is accessed all over. It must be done before the memory is
+  /// first touched. Only the whole huge pages inside the memory are
+  /// affected, and only on Linux.
+  void AdviseHugePages(void* data, const size_t size);
+
+  /// Restricts the calling thread to the logical processor with the
+  /// specified index (modulo the number of processors), so the memory
+  /// that it touches first stays close to it.
+  void PinThread(const int processor);
+
+  /// Fills the empty buffer with the specified number of copies of the
+  /// value. A large buffer is backed by huge pages. The calling thread
+  /// touches the memory first, so on a machine with several memory
+  /// nodes, the buffer is placed on the node of that thread.
+  template <typename T>
+  void AllocateBuffer(std::vector<T>& buffer, const size_t size,
+                      const T value)
+  {
+    buffer.reserve(size);
+    AdviseHugePages(buffer.data(), size * sizeof(T));
+    buffer.resize(size, value);
+  }
+}
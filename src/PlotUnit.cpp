@@ -17,45 +17,397 @@
 #include "PlotUnit.h"
 
 #include <algorithm>
+#include <cmath>
 #include "TraceUnit.h"
 #include "Cie1931.h"
+#include "Platform.h"
 
 using namespace Luculentus;
 
-PlotUnit::PlotUnit(const int width, const int height)
+PlotUnit::PlotUnit(const int width, const int height,
+                   SharedFilm* sharedFilm,
+                   const ReconstructionFilter* reconstructionFilter,
+                   const int numberOfBands)
   : imageWidth(width)
   , imageHeight(height)
   , aspectRatio(static_cast<float>(width) / static_cast<float>(height))
+  , tilesX(ScreenDistribution::GetNumberOfTiles(width))
+  , tilesY(ScreenDistribution::GetNumberOfTiles(height))
+  , binsX((width + binSize - 1) / binSize)
+  , binsY((height + binSize - 1) / binSize)
+  , sortPhotons(sizeof(Vector3) * width * height > GetCacheSize(3) / 2)
+  , film(sharedFilm)
+  , filter(reconstructionFilter)
+  , marginBefore(filter ? static_cast<int>(std::ceil(filter->radius)) : 0)
+  , marginAfter(filter ? static_cast<int>(std::ceil(filter->radius)) : 1)
+  , scratchStride(marginBefore + binSize + marginAfter)
+  , spectralBands(numberOfBands)
+  , binStarts(binsX * binsY + 1)
+  , scratch(scratchStride * scratchStride)
 {
-  // Allocate a buffer to store the tristimulus values,
-  // and fill it with black.
-  tristimulusBuffer.resize(imageWidth * imageHeight, ZeroVector3());
+  // The buffer for the tristimulus values (or spectra) is allocated
+  // when the first photons are plotted, but the statistics are small,
+  // and start out empty.
+  tileStatistics.resize(ScreenDistribution::GetNumberOfTiles(width, height),
+                        ZeroTileStatistics());
+}
+
+void PlotUnit::AllocateCanvas()
+{
+  // Allocate a buffer to store the tristimulus values (or spectra),
+  // and fill it with black, unless the film is shared. The thread that
+  // plots first fills it, so the buffer is placed close to that thread.
+  const int numberOfBands = spectralBands.numberOfBands;
+  if (numberOfBands > 0 && spectralBuffer.empty())
+  {
+    AllocateBuffer(spectralBuffer, imageWidth * imageHeight * numberOfBands,
+                   0.0f);
+  }
+  else if (numberOfBands == 0 && !film && tristimulusBuffer.empty())
+  {
+    AllocateBuffer(tristimulusBuffer, imageWidth * imageHeight,
+                   ZeroVector3());
+  }
 }
 
 void PlotUnit::Clear()
 {
   std::fill(tristimulusBuffer.begin(), tristimulusBuffer.end(), ZeroVector3());
+  std::fill(spectralBuffer.begin(), spectralBuffer.end(), 0.0f);
+  std::fill(tileStatistics.begin(), tileStatistics.end(),
+            ZeroTileStatistics());
 }
 
 void PlotUnit::Plot(const TraceUnit& traceUnit)
 {
+  PlotPhotons(traceUnit.mappedPhotons, traceUnit.packedPhotons);
+  CountPaths(traceUnit.uncountedPaths);
+}
+
+void PlotUnit::Plot(const std::vector<MappedPhoton>& mappedPhotons)
+{
+  PlotPhotons(mappedPhotons, std::vector<PackedPhoton>());
+  if (film) FlushStatistics();
+}
+
+void PlotUnit::CountPaths(const std::vector<int>& uncountedPaths)
+{
+  for (size_t i = 0; i < uncountedPaths.size(); i++)
+    tileStatistics[i].count += uncountedPaths[i];
+
+  if (film) FlushStatistics();
+}
+
+void PlotUnit::PlotPhotons(const std::vector<MappedPhoton>& mappedPhotons,
+                           const std::vector<PackedPhoton>& packedPhotons)
+{
+  const size_t n = mappedPhotons.size() + packedPhotons.size();
+  AllocateCanvas();
+
+  // A pixel of spectra does not fit in a bin of the scratch buffer, so
+  // spectra are plotted in any order
+  if (!spectralBuffer.empty())
+  {
+    for (auto photon : mappedPhotons) PlotSpectrum(photon);
+    for (auto packed : packedPhotons)
+      PlotSpectrum(Unpack(packed, aspectRatio));
+    return;
+  }
+
+  // Plotting into a shared film requires sorting, so it can be locked
+  // bin by bin
+  if (film)
+  {
+    BinPhotons(mappedPhotons, packedPhotons);
+    PlotBins(&film->tristimulusBuffer[0]);
+    return;
+  }
+
+  if (sortPhotons
+      && n >= static_cast<size_t>(binsX * binsY * minimumPhotonsPerBin))
+  {
+    BinPhotons(mappedPhotons, packedPhotons);
+    PlotBins(&tristimulusBuffer[0]);
+    return;
+  }
+
   // Loop trough every mapped photon, and plot it.
-  for (auto photon : traceUnit.mappedPhotons)
+  for (auto photon : mappedPhotons)
+    PlotPhoton(photon, &tristimulusBuffer[0], 0, 0, imageWidth);
+  for (auto packed : packedPhotons)
+    PlotPhoton(Unpack(packed, aspectRatio), &tristimulusBuffer[0], 0, 0,
+               imageWidth);
+}
+
+void PlotUnit::BinPhotons(const std::vector<MappedPhoton>& mappedPhotons,
+                          const std::vector<PackedPhoton>& packedPhotons)
+{
+  const size_t n = mappedPhotons.size() + packedPhotons.size();
+  photonBins.resize(n);
+  binnedPhotons.resize(n);
+
+  // First count the photons in every bin (shifted by one, so the prefix
+  // sum becomes the start of the bin)
+  std::fill(binStarts.begin(), binStarts.end(), 0);
+  for (size_t i = 0; i < mappedPhotons.size(); i++)
+  {
+    photonBins[i] = GetBin(mappedPhotons[i]);
+    binStarts[photonBins[i] + 1]++;
+  }
+  for (size_t i = 0; i < packedPhotons.size(); i++)
+  {
+    const int bin = GetBin(Unpack(packedPhotons[i], aspectRatio));
+    photonBins[mappedPhotons.size() + i] = bin;
+    binStarts[bin + 1]++;
+  }
+
+  for (size_t b = 1; b < binStarts.size(); b++)
+    binStarts[b] += binStarts[b - 1];
+
+  // Then put every photon in its place, the start of a bin moves along
+  // while it is filled, and ends up at the start of the next bin
+  for (size_t i = 0; i < mappedPhotons.size(); i++)
+    binnedPhotons[binStarts[photonBins[i]]++] = mappedPhotons[i];
+  for (size_t i = 0; i < packedPhotons.size(); i++)
+  {
+    binnedPhotons[binStarts[photonBins[mappedPhotons.size() + i]]++]
+      = Unpack(packedPhotons[i], aspectRatio);
+  }
+
+  // So shift the starts back
+  for (size_t b = binStarts.size() - 1; b > 0; b--)
+    binStarts[b] = binStarts[b - 1];
+  binStarts[0] = 0;
+}
+
+int PlotUnit::GetBin(const MappedPhoton photon) const
+{
+  const float px = (photon.x * 0.5f + 0.5f) * (imageWidth - 1);
+  const float py = (photon.y * aspectRatio * 0.5f + 0.5f) * (imageHeight - 1);
+  const int bx = std::max(0, std::min(imageWidth - 1, static_cast<int>(px)))
+               / binSize;
+  const int by = std::max(0, std::min(imageHeight - 1, static_cast<int>(py)))
+               / binSize;
+  return by * binsX + bx;
+}
+
+void PlotUnit::PlotBins(Vector3* canvas)
+{
+  for (int b = 0; b < binsX * binsY; b++)
   {
-    // Calculate the CIE tristimulus values, given the wavelength.
-    Vector3 cie = Cie1931::GetTristimulus(photon.wavelength);
+    const int begin = binStarts[b];
+    const int end = binStarts[b + 1];
+    if (begin == end) continue;
+
+    // Few photons can be plotted into the canvas directly, the part of
+    // the canvas they touch stays in cache while they are plotted
+    if (end - begin < minimumScratchPhotons)
+    {
+      LockBin(b);
+      for (int i = begin; i < end; i++)
+        PlotPhoton(binnedPhotons[i], canvas, 0, 0, imageWidth);
+      UnlockBin(b);
+      continue;
+    }
 
-    // Then plot the pixel into the buffer.
-    PlotPixel(photon.x, photon.y, cie * photon.probability);
+    // Otherwise plot them into the scratch buffer, which does not
+    // suffer from cache associativity conflicts between rows
+    const int x0 = (b % binsX) * binSize - marginBefore;
+    const int y0 = (b / binsX) * binSize - marginBefore;
+    std::fill(scratch.begin(), scratch.end(), ZeroVector3());
+
+    for (int i = begin; i < end; i++)
+      PlotPhoton(binnedPhotons[i], &scratch[0], x0, y0, scratchStride);
+
+    // Then add it to the canvas (it may extend beyond the edges)
+    const int xBegin = std::max(0, x0);
+    const int yBegin = std::max(0, y0);
+    const int xEnd = std::min(imageWidth, x0 + scratchStride);
+    const int yEnd = std::min(imageHeight, y0 + scratchStride);
+    LockBin(b);
+    for (int y = yBegin; y < yEnd; y++)
+    {
+      Vector3* row = canvas + y * imageWidth;
+      const Vector3* scratchRow = &scratch[(y - y0) * scratchStride];
+      for (int x = xBegin; x < xEnd; x++) row[x] += scratchRow[x - x0];
+    }
+    UnlockBin(b);
   }
 }
 
-void PlotUnit::PlotPixel(float x, float y, Vector3 cie)
+void PlotUnit::LockBin(const int bin)
 {
+  if (!film) return;
+
+  // Filtered photons reach into the neighbours on all sides, bilinear
+  // ones only into those to the right and bottom
+  const int before = marginBefore > 0 ? 1 : 0;
+  const int xBegin = std::max(0, bin % binsX - before);
+  const int yBegin = std::max(0, bin / binsX - before);
+  const int xEnd = std::min(binsX - 1, bin % binsX + 1);
+  const int yEnd = std::min(binsY - 1, bin / binsX + 1);
+
+  // In increasing order, so two plot units cannot wait for each other
+  for (int y = yBegin; y <= yEnd; y++)
+    for (int x = xBegin; x <= xEnd; x++)
+      film->Lock(y * binsX + x);
+}
+
+void PlotUnit::UnlockBin(const int bin)
+{
+  if (!film) return;
+
+  const int before = marginBefore > 0 ? 1 : 0;
+  const int xBegin = std::max(0, bin % binsX - before);
+  const int yBegin = std::max(0, bin / binsX - before);
+  const int xEnd = std::min(binsX - 1, bin % binsX + 1);
+  const int yEnd = std::min(binsY - 1, bin / binsX + 1);
+
+  for (int y = yEnd; y >= yBegin; y--)
+    for (int x = xEnd; x >= xBegin; x--)
+      film->Unlock(y * binsX + x);
+}
+
+void PlotUnit::FlushStatistics()
+{
+  const int tilesPerBin = binSize / ScreenDistribution::tileSize;
+
+  for (int b = 0; b < binsX * binsY; b++)
+  {
+    const int tx0 = (b % binsX) * tilesPerBin;
+    const int ty0 = (b / binsX) * tilesPerBin;
+    const int tx1 = std::min(tilesX, tx0 + tilesPerBin);
+    const int ty1 = std::min(tilesY, ty0 + tilesPerBin);
+
+    // Only lock regions whose statistics changed. The count alone does
+    // not tell: splats of the bidirectional tracer are subtracted from
+    // it after they were plotted, which can leave it at zero or below.
+    bool changed = false;
+    for (int ty = ty0; ty < ty1; ty++)
+    {
+      for (int tx = tx0; tx < tx1; tx++)
+      {
+        const TileStatistics& stats = tileStatistics[ty * tilesX + tx];
+        changed = changed || stats.count != 0.0 || stats.sum != 0.0
+                          || stats.sumOfSquares != 0.0;
+      }
+    }
+    if (!changed) continue;
+
+    film->Lock(b);
+    for (int ty = ty0; ty < ty1; ty++)
+    {
+      for (int tx = tx0; tx < tx1; tx++)
+      {
+        film->tileStatistics[ty * tilesX + tx] +=
+          tileStatistics[ty * tilesX + tx];
+        tileStatistics[ty * tilesX + tx] = ZeroTileStatistics();
+      }
+    }
+    film->Unlock(b);
+  }
+}
+
+void PlotUnit::PlotPhoton(const MappedPhoton photon, Vector3* target,
+                          const int x0, const int y0, const int stride)
+{
+  // Calculate the CIE tristimulus values, given the wavelength.
+  Vector3 cie = Cie1931::GetTristimulus(photon.wavelength)
+              * photon.probability;
+
   // Map the position to some pixels.
-  float px = (x * 0.5f + 0.5f) * (imageWidth - 1);
-  float py = (y * aspectRatio * 0.5f + 0.5f) * (imageHeight - 1);
-    
+  float px = (photon.x * 0.5f + 0.5f) * (imageWidth - 1);
+  float py = (photon.y * aspectRatio * 0.5f + 0.5f) * (imageHeight - 1);
+
+  // Then plot the pixel into the buffer.
+  if (filter) PlotFiltered(px, py, cie, target, x0, y0, stride);
+  else PlotPixel(px, py, cie, target, x0, y0, stride);
+
+  // And record the luminance, to estimate the variance of the tile.
+  RecordStatistics(px, py, cie.y);
+}
+
+void PlotUnit::PlotSpectrum(const MappedPhoton photon)
+{
+  const int band = spectralBands.GetBand(photon.wavelength);
+  const int numberOfBands = spectralBands.numberOfBands;
+
+  // Map the position to some pixels.
+  float px = (photon.x * 0.5f + 0.5f) * (imageWidth - 1);
+  float py = (photon.y * aspectRatio * 0.5f + 0.5f) * (imageHeight - 1);
+
+  int xBegin, yBegin;
+  float wx[maximumFootprint], wy[maximumFootprint];
+  const int w = GetWeights(px, imageWidth, xBegin, wx);
+  const int h = GetWeights(py, imageHeight, yBegin, wy);
+
+  // Add the photon to its band in every pixel it reaches.
+  for (int j = 0; j < h; j++)
+  {
+    float* row = &spectralBuffer[((yBegin + j) * imageWidth + xBegin)
+                                 * numberOfBands + band];
+    const float c = photon.probability * wy[j];
+    for (int i = 0; i < w; i++)
+    {
+      row[i * numberOfBands] += c * wx[i];
+    }
+  }
+
+  // The luminance is that of the standard observer, it only serves to
+  // estimate the variance.
+  RecordStatistics(px, py, Cie1931::GetTristimulus(photon.wavelength).y
+                           * photon.probability);
+}
+
+void PlotUnit::RecordStatistics(const float px, const float py,
+                                const float luminance)
+{
+  int tx = std::max(0, std::min(tilesX - 1, static_cast<int>(px)
+                                            / ScreenDistribution::tileSize));
+  int ty = std::max(0, std::min(tilesY - 1, static_cast<int>(py)
+                                            / ScreenDistribution::tileSize));
+  TileStatistics& stats = tileStatistics[ty * tilesX + tx];
+  stats.count        += 1.0;
+  stats.sum          += luminance;
+  stats.sumOfSquares += luminance * luminance;
+}
+
+int PlotUnit::GetWeights(float p, const int size, int& begin,
+                         float* weights) const
+{
+  // Photons outside of the canvas end up at the edge.
+  p = std::max(0.0f, std::min(static_cast<float>(size - 1), p));
+
+  if (filter)
+  {
+    const float r = filter->radius;
+    begin = std::max(0, static_cast<int>(std::ceil(p - r)));
+    const int end = std::min(size - 1, static_cast<int>(std::floor(p + r)));
+
+    float sum = 0.0f;
+    for (int i = 0; i <= end - begin; i++)
+      sum += weights[i] = (*filter)(begin + i - p);
+
+    // They are normalised, so every photon adds the same amount of
+    // light, also near the edges. A filter with negative lobes might
+    // cancel out completely though, then plot bilinearly.
+    if (sum > 0.0f)
+    {
+      for (int i = 0; i <= end - begin; i++) weights[i] /= sum;
+      return end - begin + 1;
+    }
+  }
+
+  // The two nearest pixels, or one at the far edge.
+  begin = static_cast<int>(p);
+  weights[0] = 1.0f - (p - begin);
+  weights[1] = p - begin;
+  return std::min(2, size - begin);
+}
+
+void PlotUnit::PlotPixel(float px, float py, Vector3 cie, Vector3* target,
+                         const int x0, const int y0, const int stride)
+{
   // Map to discrete pixels.
   int px1 = std::max(0, std::min(imageWidth - 1,
                           static_cast<int>(std::floor(px))));
@@ -75,8 +427,40 @@ void PlotUnit::PlotPixel(float x, float y, Vector3 cie)
   float c22 = cx * cy;
 
   // Plot the four pixels.
-  tristimulusBuffer[py1 * imageWidth + px1] += cie * c11;
-  tristimulusBuffer[py1 * imageWidth + px2] += cie * c21;
-  tristimulusBuffer[py2 * imageWidth + px1] += cie * c12;
-  tristimulusBuffer[py2 * imageWidth + px2] += cie * c22;
+  target[(py1 - y0) * stride + px1 - x0] += cie * c11;
+  target[(py1 - y0) * stride + px2 - x0] += cie * c21;
+  target[(py2 - y0) * stride + px1 - x0] += cie * c12;
+  target[(py2 - y0) * stride + px2 - x0] += cie * c22;
+}
+
+void PlotUnit::PlotFiltered(float px, float py, Vector3 cie, Vector3* target,
+                            const int x0, const int y0, const int stride)
+{
+  static_assert(sizeof(Vector3) == 3 * sizeof(float),
+                "rows of pixels are added as rows of floats");
+
+  // The filter is separable, so the weights of a row and a column
+  // suffice.
+  int xBegin, yBegin;
+  float wx[maximumFootprint], wy[maximumFootprint];
+  const int w = GetWeights(px, imageWidth, xBegin, wx);
+  const int h = GetWeights(py, imageHeight, yBegin, wy);
+
+  // Weigh the tristimulus value once for every column.
+  float kernel[3 * maximumFootprint];
+  for (int i = 0; i < w; i++)
+  {
+    kernel[3 * i + 0] = cie.x * wx[i];
+    kernel[3 * i + 1] = cie.y * wx[i];
+    kernel[3 * i + 2] = cie.z * wx[i];
+  }
+
+  // Then add a scaled copy of it to every row, as contiguous floats, so
+  // the compiler can vectorise the loop.
+  for (int j = 0; j < h; j++)
+  {
+    float* row = reinterpret_cast<float*>(
+      target + (yBegin + j - y0) * stride + xBegin - x0);
+    for (int k = 0; k < 3 * w; k++) row[k] += kernel[k] * wy[j];
+  }
 }
@@ -17,13 +17,20 @@
 #pragma once
 
 #include <vector>
+#include "MappedPhoton.h"
+#include "ReconstructionFilter.h"
+#include "ScreenDistribution.h"
+#include "SharedFilm.h"
+#include "SpectralBands.h"
 #include "Vector3.h"
 
 namespace Luculentus
 {
   class TraceUnit;
 
-  /// Handles plotting the results of a TraceUnit.
+  /// Handles plotting the results of a TraceUnit. Photons are sorted by
+  /// the part of the screen they land in first, so plotting them touches
+  /// only a small part of the buffer at a time.
   class PlotUnit
   {
     public:
@@ -37,23 +44,175 @@ namespace Luculentus
       /// Width of the canvas divided by its height.
       const float aspectRatio;
 
-      /// The buffer of tristimulus values.
+      /// The number of tiles in horizontal direction.
+      const int tilesX;
+
+      /// The number of tiles in vertical direction.
+      const int tilesY;
+
+      /// The buffer of tristimulus values. Empty when the plot unit plots
+      /// into a shared film, or has not plotted anything yet.
       std::vector<Vector3> tristimulusBuffer;
 
-      /// Constructs a new plot unit that will plot to a canvas
-      /// of the specified size.
-      PlotUnit(const int width, const int height);
+      /// The light in every spectral band of every pixel, if the plot
+      /// unit records spectra (its tristimulus buffer is empty then).
+      /// Empty until the plot unit plots something.
+      std::vector<float> spectralBuffer;
+
+      /// Statistics about the photons plotted into every tile. When the
+      /// plot unit plots into a shared film, they are added to the film
+      /// after every plot.
+      std::vector<TileStatistics> tileStatistics;
+
+      /// Constructs a new plot unit that will plot to a canvas of the
+      /// specified size. If a shared film is specified, it plots into
+      /// the film instead of a canvas of its own. If a filter is
+      /// specified, photons are spread out with it, rather than over the
+      /// four nearest pixels. If a number of spectral bands is specified,
+      /// photons are recorded per band instead of as tristimulus values.
+      PlotUnit(const int width, const int height, SharedFilm* sharedFilm,
+               const ReconstructionFilter* reconstructionFilter,
+               const int numberOfBands);
 
       /// Plots the result of the specified TraceUnit onto the canvas.
       void Plot(const TraceUnit& traceUnit);
 
-      /// Resets the tristimulus buffer.
+      /// Plots the photons onto the canvas.
+      void Plot(const std::vector<MappedPhoton>& mappedPhotons);
+
+      /// Corrects the photon count of every tile by the specified number
+      /// of paths that were not plotted as a photon of their own (see
+      /// TraceUnit::uncountedPaths).
+      void CountPaths(const std::vector<int>& uncountedPaths);
+
+      /// Resets the tristimulus buffer and tile statistics.
       void Clear();
 
     private:
 
-      /// Plots a pixel, anti-aliased into the buffer
-      /// (adding it to existing content).
-      void PlotPixel(float x, float y, Vector3 cie);
+      /// The width and height of the bins that photons are sorted into
+      /// (in pixels). A bin of tristimulus values fits in the level 1
+      /// cache, and a bin is a region of the shared film.
+      static const int binSize = SharedFilm::regionSize;
+
+      /// The average number of photons per bin below which photons are
+      /// not sorted, because the sort would cost more than it saves.
+      static const int minimumPhotonsPerBin = 8;
+
+      /// The number of photons in a bin above which they are plotted
+      /// into a separate buffer for the bin first, which is then added
+      /// to the canvas at once. For fewer photons, clearing and adding
+      /// that buffer is more work than it saves.
+      static const int minimumScratchPhotons = binSize * binSize / 2;
+
+      /// The largest number of pixels along one axis that a photon can
+      /// reach.
+      static const int maximumFootprint =
+        2 * ReconstructionFilter::maximumRadius + 1;
+
+      /// The number of bins in horizontal and vertical direction.
+      const int binsX, binsY;
+
+      /// Whether photons are sorted at all. When the canvas fits in the
+      /// last level cache, plotting in any order is fast already.
+      const bool sortPhotons;
+
+      /// The film that is plotted into, or null if the plot unit has a
+      /// canvas of its own (not owned).
+      SharedFilm* film;
+
+      /// The filter that photons are plotted with, or null to plot them
+      /// bilinearly (not owned).
+      const ReconstructionFilter* filter;
+
+      /// The number of pixels to the left of and above its bin that a
+      /// photon can reach.
+      const int marginBefore;
+
+      /// The number of pixels to the right of and below its bin that a
+      /// photon can reach.
+      const int marginAfter;
+
+      /// The width of a row of the scratch buffer (in pixels).
+      const int scratchStride;
+
+      /// The bands that photons are recorded in, if there are any.
+      const SpectralBands spectralBands;
+
+      /// The index of the first photon of every bin in binnedPhotons,
+      /// followed by the total number of photons.
+      std::vector<int> binStarts;
+
+      /// The bin of every photon that is being plotted.
+      std::vector<int> photonBins;
+
+      /// The photons that are being plotted, sorted by bin.
+      std::vector<MappedPhoton> binnedPhotons;
+
+      /// The tristimulus values of a bin and the margin around it, which
+      /// photons in the bin reach too.
+      std::vector<Vector3> scratch;
+
+      /// Allocates the buffer that photons are plotted into, unless it
+      /// was allocated already.
+      void AllocateCanvas();
+
+      /// Plots both kinds of photons, sorted by bin if there are enough.
+      void PlotPhotons(const std::vector<MappedPhoton>& mappedPhotons,
+                       const std::vector<PackedPhoton>& packedPhotons);
+
+      /// Sorts the photons by bin into binnedPhotons (a counting sort).
+      void BinPhotons(const std::vector<MappedPhoton>& mappedPhotons,
+                      const std::vector<PackedPhoton>& packedPhotons);
+
+      /// Returns the bin that the photon lands in.
+      int GetBin(const MappedPhoton photon) const;
+
+      /// Plots the binned photons, bin by bin.
+      void PlotBins(Vector3* canvas);
+
+      /// Locks the regions of the shared film that photons in the bin
+      /// can reach: the bin itself, its neighbours to the right and
+      /// bottom, and with a filter also those to the left and top. Does
+      /// nothing without a shared film.
+      void LockBin(const int bin);
+
+      /// Releases the regions locked by LockBin.
+      void UnlockBin(const int bin);
+
+      /// Adds the tile statistics to the shared film, and clears them.
+      void FlushStatistics();
+
+      /// Plots a single photon into the spectral buffer, and records it in
+      /// the tile statistics.
+      void PlotSpectrum(const MappedPhoton photon);
+
+      /// Records the luminance of a photon at the specified (continuous)
+      /// pixel coordinates in the statistics of its tile.
+      void RecordStatistics(const float px, const float py,
+                            const float luminance);
+
+      /// Computes the weights of the pixels along one axis (of the
+      /// specified size) that a photon at the (continuous) coordinate
+      /// reaches, such that they add up to one. Returns the number of
+      /// pixels, the first of which is stored in begin.
+      int GetWeights(float p, const int size, int& begin,
+                     float* weights) const;
+
+      /// Plots a single photon into the target, and records it in the
+      /// tile statistics. The target covers the part of the canvas with
+      /// the specified top left pixel, in rows of the specified width.
+      void PlotPhoton(const MappedPhoton photon, Vector3* target,
+                      const int x0, const int y0, const int stride);
+
+      /// Plots a pixel at the specified (continuous) pixel coordinates,
+      /// anti-aliased into the target (adding it to existing content).
+      void PlotPixel(float px, float py, Vector3 cie, Vector3* target,
+                     const int x0, const int y0, const int stride);
+
+      /// Plots a pixel at the specified (continuous) pixel coordinates,
+      /// spread out with the reconstruction filter into the target.
+      void PlotFiltered(float px, float py, Vector3 cie, Vector3* target,
+                        const int x0, const int y0, const int stride);
   };
 }
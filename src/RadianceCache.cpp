@@ -0,0 +1,88 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "RadianceCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include "AtomicFloat.h"
+#include "SpatialHash.h"
+
+using namespace Luculentus;
+
+const float RadianceCache::voxelSize = 1.0f;
+
+RadianceCache::RadianceCache()
+  : entries(numberOfCells * numberOfBands)
+{
+  for (auto& entry : entries)
+  {
+    entry.radianceSum.store(0.0f);
+    entry.samples.store(0);
+  }
+}
+
+void RadianceCache::Record(const Vector3 position, const Vector3 normal,
+                           const float wavelength, const float radiance)
+{
+  Entry& entry = entries[GetIndex(position, normal, wavelength)];
+
+  // The count is only used as a threshold, so it does not matter that
+  // the two are not updated together
+  AtomicAdd(entry.radianceSum, radiance);
+  entry.samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool RadianceCache::Lookup(const Vector3 position, const Vector3 normal,
+                           const float wavelength, float& radiance) const
+{
+  const Entry& entry = entries[GetIndex(position, normal, wavelength)];
+
+  const int samples = entry.samples.load(std::memory_order_relaxed);
+  if (samples < minimumSamples) return false;
+
+  radiance = entry.radianceSum.load(std::memory_order_relaxed) / samples;
+  return true;
+}
+
+int RadianceCache::GetIndex(const Vector3 position, const Vector3 normal,
+                            const float wavelength)
+{
+  const int x = static_cast<int>(std::floor(position.x / voxelSize));
+  const int y = static_cast<int>(std::floor(position.y / voxelSize));
+  const int z = static_cast<int>(std::floor(position.z / voxelSize));
+
+  // Both sides of a surface, and surfaces of different orientation
+  // that meet in one voxel, reflect different light, so the dominant
+  // axis of the normal (and its sign) is part of the key
+  const float ax = std::abs(normal.x);
+  const float ay = std::abs(normal.y);
+  const float az = std::abs(normal.z);
+  const int side = ax >= ay && ax >= az ? (normal.x > 0.0f ? 0 : 1)
+                 : ay >= az             ? (normal.y > 0.0f ? 2 : 3)
+                 :                        (normal.z > 0.0f ? 4 : 5);
+
+  const unsigned int h = HashCell(x, y, z)
+                       ^ (static_cast<unsigned int>(side) * 2654435761u);
+  const int cell = static_cast<int>(h % numberOfCells);
+
+  // Wavelengths are in the range 380 .. 780
+  const int band = static_cast<int>((wavelength - 380.0f) / 400.0f
+                                    * numberOfBands);
+
+  return cell * numberOfBands
+       + std::max(0, std::min(numberOfBands - 1, band));
+}
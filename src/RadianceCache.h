@@ -0,0 +1,81 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  /// Remembers the light that diffuse surfaces reflect, so paths can end
+  /// early by looking it up. Space is divided into voxels, which are
+  /// hashed together with the side of the surface into a fixed number of
+  /// cells, and every cell stores the average radiance per band of
+  /// wavelengths. All trace units read and write the same cache
+  /// concurrently, without locks.
+  class RadianceCache
+  {
+    public:
+
+      /// The number of cells that voxels are hashed into.
+      static const int numberOfCells = 1 << 16;
+
+      /// The number of wavelength bands per cell.
+      static const int numberOfBands = 8;
+
+      /// The number of samples a band must have before it is used.
+      static const int minimumSamples = 16;
+
+      /// The width of a voxel (in scene units).
+      static const float voxelSize;
+
+      /// Creates an empty cache.
+      RadianceCache();
+
+      /// Records a sample of the radiance that the surface at the
+      /// position, facing the normal, reflects at the wavelength.
+      /// This method is thread-safe.
+      void Record(const Vector3 position, const Vector3 normal,
+                  const float wavelength, const float radiance);
+
+      /// Sets the radiance to the average that was recorded for the
+      /// surface, and returns whether enough samples were recorded for
+      /// the average to be useful. This method is thread-safe.
+      bool Lookup(const Vector3 position, const Vector3 normal,
+                  const float wavelength, float& radiance) const;
+
+    private:
+
+      /// The samples of one wavelength band of a cell.
+      struct Entry
+      {
+        /// The sum of the recorded radiance.
+        std::atomic<float> radianceSum;
+
+        /// The number of samples recorded.
+        std::atomic<int> samples;
+      };
+
+      /// The entries of all bands, per cell.
+      std::vector<Entry> entries;
+
+      /// Returns the index of the entry for the surface and wavelength.
+      static int GetIndex(const Vector3 position, const Vector3 normal,
+                          const float wavelength);
+  };
+}
@@ -16,10 +16,12 @@
 
 #include "Raytracer.h"
 
+#include <iostream>
 #include "Constants.h"
 #include "TraceUnit.h"
 #include "PlotUnit.h"
 #include "GatherUnit.h"
+#include "Platform.h"
 #include "TonemapUnit.h"
 #include "Compound.h"
 
@@ -38,12 +40,15 @@ const int Raytracer::numberOfThreads =
 const int Raytracer::numberOfThreads = 1; 
 #endif
 
-Raytracer::Raytracer(UserInterface& ui)
-  : taskScheduler(numberOfThreads, imageWidth, imageHeight, scene)
+Raytracer::Raytracer(UserInterface& ui, const Settings& renderSettings)
+  : settings(renderSettings)
+  , taskScheduler(numberOfThreads, imageWidth, imageHeight, scene,
+                  renderSettings)
   , userInterface(ui)
   , scene(BuildScene())
 {
-
+  // Gather the information the integrators need about the scene
+  scene.Compile();
 }
 
 void Raytracer::StartRendering()
@@ -56,8 +61,10 @@ void Raytracer::StartRendering()
 
 void Raytracer::StopRendering()
 {
-  // Signal all threads to stop rendering
+  // Signal all threads to stop rendering, also those that are waiting
+  // for work
   continueRendering = false;
+  taskScheduler.WakeWorkers();
 
   // Then wait until the main thread is done
   // waiting for the worker threads
@@ -70,7 +77,7 @@ void Raytracer::RunMain()
   for (int i = 0; i < numberOfThreads; i++)
   {
     // Execute the RunWorker method on the worker thread
-    workerThreads.emplace_back(&Raytracer::RunWorker, this);
+    workerThreads.emplace_back(&Raytracer::RunWorker, this, i);
   }
 
   // And then wait for all threads to finish
@@ -78,33 +85,84 @@ void Raytracer::RunMain()
   {
     thread.join();
   }
+
+  // If the threads stopped because the image is done (and not because
+  // the window was closed), save the result
+  if (taskScheduler.IsDone()) Finish();
+}
+
+bool Raytracer::Retonemap(const Settings& settings)
+{
+  GatherUnit gatherUnit(imageWidth, imageHeight, 0, false);
+  if (!gatherUnit.LoadSpectra(settings.filmInputFile))
+  {
+    std::cerr << "could not read " << settings.filmInputFile << std::endl;
+    return false;
+  }
+
+  TonemapUnit tonemapUnit(imageWidth, imageHeight, settings);
+  tonemapUnit.Tonemap(gatherUnit);
+
+  if (!tonemapUnit.Save(settings.outputFile))
+  {
+    std::cerr << "could not write " << settings.outputFile << std::endl;
+    return false;
+  }
+
+  std::cout << "image written to " << settings.outputFile << std::endl;
+  return true;
 }
 
-void Raytracer::RunWorker()
+void Raytracer::Finish()
 {
+  if (!settings.outputFile.empty())
+  {
+    if (taskScheduler.tonemapUnit->Save(settings.outputFile))
+      std::cout << "image written to " << settings.outputFile << std::endl;
+    else
+      std::cerr << "could not write " << settings.outputFile << std::endl;
+  }
+
+  if (!settings.filmOutputFile.empty())
+  {
+    if (taskScheduler.gatherUnit->SaveSpectra(settings.filmOutputFile))
+      std::cout << "film written to " << settings.filmOutputFile << std::endl;
+    else
+      std::cerr << "could not write " << settings.filmOutputFile << std::endl;
+  }
+
+  // Rendering is done, so the window can be closed as well
+  userInterface.Close();
+}
+
+void Raytracer::RunWorker(const int worker)
+{
+  // Keep the worker on one processor, so the units it uses stay close
+  if (settings.pinThreads) PinThread(worker);
+
   // There is no task yet, but the task scheduler expects a completed
   // task. Therefore, this worker is done sleeping.
   Task task;
   task.type = Task::Sleep;
 
-  // Until something signals this worker to stop,
-  // continue executing tasks.
-  while (continueRendering)
+  // Until something signals this worker to stop, or until the image is
+  // done, continue executing tasks.
+  while (continueRendering && !taskScheduler.IsDone())
   {
     // Ask the task scheduler for a new task
-    task = taskScheduler.GetNewTask(task);
+    task = taskScheduler.GetNewTask(task, worker);
 
     // And execute it
-    ExecuteTask(task);
+    ExecuteTask(task, worker);
   }
 }
 
-void Raytracer::ExecuteTask(const Task task)
+void Raytracer::ExecuteTask(const Task task, const int worker)
 {
   // Delegate the task to the correct method
   switch (task.type)
   {
-    case Task::Sleep:   ExecuteSleepTask(task);   break;
+    case Task::Sleep:   ExecuteSleepTask(task, worker); break;
     case Task::Trace:   ExecuteTraceTask(task);   break;
     case Task::Plot:    ExecutePlotTask(task);    break;
     case Task::Gather:  ExecuteGatherTask(task);  break;
@@ -112,17 +170,26 @@ void Raytracer::ExecuteTask(const Task task)
   }
 }
 
-void Raytracer::ExecuteSleepTask(const Task)
+void Raytracer::ExecuteSleepTask(const Task, const int worker)
 {
-  // Sleep 100 ms, then the task is done
-  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  // Wait until a unit becomes available, then the task is done
+  taskScheduler.WaitForWork(worker);
   // That wasn't too hard
 }
 
 void Raytracer::ExecuteTraceTask(const Task task)
 {
   // Let the trace unit do all the work, then the task is done
-  taskScheduler.traceUnits[task.unit].Render();
+  auto screenDistribution = taskScheduler.GetScreenDistribution();
+  auto guidingDistribution = taskScheduler.GetGuidingDistribution();
+
+  // A fused trace task plots into the plot unit it was given
+  PlotUnit* plotUnit = task.otherUnits.empty()
+                     ? nullptr : &taskScheduler.plotUnits[task.otherUnits[0]];
+
+  taskScheduler.traceUnits[task.unit].Render(task.numberOfPaths,
+                                             *screenDistribution,
+                                             *guidingDistribution, plotUnit);
 }
 
 void Raytracer::ExecutePlotTask(Task task)
@@ -142,20 +209,50 @@ void Raytracer::ExecutePlotTask(Task task)
 
 void Raytracer::ExecuteGatherTask(Task task)
 {
-  // Loop through all plot units that need to be gathered
-  while (!task.otherUnits.empty())
+  // Every part but the final one accumulates a strip of the plot units
+  // that need to be gathered, which clears the strip as well, so the
+  // data does not get accumulated twice
+  const int part = task.unit;
+  if (part < taskScheduler.numberOfGatherParts)
   {
-    // Take one plot unit
-    int index = task.otherUnits.back();
-    task.otherUnits.pop_back();
-    auto& plotUnit = taskScheduler.plotUnits[index];
+    for (int index : task.otherUnits)
+    {
+      taskScheduler.gatherUnit->Accumulate(taskScheduler.plotUnits[index],
+                                           part,
+                                           taskScheduler.numberOfGatherParts);
+    }
+    return;
+  }
 
-    // Accumulate the plotted data into the gather unit
-    taskScheduler.gatherUnit->Accumulate(plotUnit);
+  // The final part runs once all strips are done, and accumulates the
+  // statistics
+  for (int index : task.otherUnits)
+  {
+    taskScheduler.gatherUnit->AccumulateStatistics(
+      taskScheduler.plotUnits[index]);
+  }
+
+  // Plot units that share a film have plotted into it already, the
+  // gather unit adds what was plotted since the last gather
+  if (taskScheduler.sharedFilm)
+  {
+    taskScheduler.sharedFilm->DrainInto(*taskScheduler.gatherUnit);
+  }
 
-    // And then clear the plot unit,
-    // so the data does not get accumulated twice
-    plotUnit.Clear();
+  // With more photons gathered, the noise estimate has improved, so
+  // steer new paths towards the parts of the image that need them most
+  if (settings.adaptiveSampling)
+  {
+    taskScheduler.SetScreenDistribution(
+      std::make_shared<ScreenDistribution>(*taskScheduler.gatherUnit));
+  }
+
+  // The paths traced since the last gather taught the guiding field
+  // more about where light comes from, so let new paths benefit
+  if (taskScheduler.guidingField)
+  {
+    taskScheduler.SetGuidingDistribution(
+      std::make_shared<GuidingDistribution>(*taskScheduler.guidingField));
   }
 }
 
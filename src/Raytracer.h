@@ -20,6 +20,7 @@
 #include <thread>
 #include "UserInterface.h"
 #include "Scene.h"
+#include "Settings.h"
 #include "TaskScheduler.h"
 
 namespace Luculentus
@@ -29,7 +30,7 @@ namespace Luculentus
     public:
 
       /// Creates a new raytracer
-      Raytracer(UserInterface& ui);
+      Raytracer(UserInterface& ui, const Settings& renderSettings);
 
       /// Starts rendering on separate threads
       void StartRendering();
@@ -37,6 +38,11 @@ namespace Luculentus
       // Waits for all rendering tasks to finish, and then stops
       void StopRendering();
 
+      /// Tonemaps the film that was saved before with the observer and
+      /// white balance of the settings, and writes the image to the
+      /// output file, without rendering. Returns whether that succeeded.
+      static bool Retonemap(const Settings& settings);
+
     private:
 
       /// Width of the rendered image
@@ -51,6 +57,9 @@ namespace Luculentus
       /// Number of worker threads
       static const int numberOfThreads;
 
+      /// Options that control rendering.
+      const Settings settings;
+
       /// Whether to not stop rendering
       std::atomic<bool> continueRendering;
 
@@ -73,15 +82,20 @@ namespace Luculentus
       /// Method executed on the main thread
       void RunMain();
 
-      /// Method executed by worker threads
-      void RunWorker();
+      /// Writes the final image to the output file, if there is one,
+      /// and closes the user interface.
+      void Finish();
+
+      /// Method executed by worker threads, with the index of the worker
+      void RunWorker(const int worker);
 
       /// Runs one of the specialised task execution methods,
-      /// based on the task type.
-      void ExecuteTask(const Task task);
+      /// based on the task type, on the worker with the index.
+      void ExecuteTask(const Task task, const int worker);
 
-      /// Handles the 'Sleep' task, sleeps 100 ms.
-      void ExecuteSleepTask(const Task task);
+      /// Handles the 'Sleep' task, waits until the worker might have
+      /// something to do.
+      void ExecuteSleepTask(const Task task, const int worker);
 
       /// Executes a 'Trace' task.
       void ExecuteTraceTask(const Task task);
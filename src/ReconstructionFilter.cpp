@@ -0,0 +1,82 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "ReconstructionFilter.h"
+
+#include "Constants.h"
+
+using namespace Luculentus;
+
+ReconstructionFilter::ReconstructionFilter(const Settings::Filter type,
+                                           const float r)
+  : radius(std::min(static_cast<float>(maximumRadius), r))
+  , samplesPerPixel(numberOfSamples / radius)
+  , samples(numberOfSamples)
+{
+  for (int i = 0; i < numberOfSamples; i++)
+  {
+    // Sample in the middle of the step, t runs from 0 to 1
+    const float t = (i + 0.5f) / numberOfSamples;
+
+    switch (type)
+    {
+      case Settings::Gaussian:
+      {
+        // With the standard deviation a third of the radius, and
+        // shifted down so it reaches zero at the radius
+        const float alpha = 4.5f;
+        samples[i] = std::exp(-alpha * t * t) - std::exp(-alpha);
+        break;
+      }
+
+      case Settings::Mitchell:
+      {
+        // The cubic spans two units
+        const float x = t * 2.0f;
+        const float b = 1.0f / 3.0f;
+        const float c = 1.0f / 3.0f;
+        samples[i] = x < 1.0f
+          ? ((12.0f - 9.0f * b - 6.0f * c) * x * x * x
+             + (-18.0f + 12.0f * b + 6.0f * c) * x * x
+             + (6.0f - 2.0f * b)) / 6.0f
+          : ((-b - 6.0f * c) * x * x * x
+             + (6.0f * b + 30.0f * c) * x * x
+             + (-12.0f * b - 48.0f * c) * x
+             + (8.0f * b + 24.0f * c)) / 6.0f;
+        break;
+      }
+
+      case Settings::BlackmanHarris:
+      {
+        // The window spans n = 0 .. 1, with its peak at the centre
+        const double n = 0.5 + 0.5 * t;
+        samples[i] = static_cast<float>(0.35875
+                                        - 0.48829 * std::cos(2.0 * pi * n)
+                                        + 0.14128 * std::cos(4.0 * pi * n)
+                                        - 0.01168 * std::cos(6.0 * pi * n));
+        break;
+      }
+
+      case Settings::Bilinear:
+      {
+        // Plot units plot bilinearly without a filter, but a tent of
+        // radius one is what that amounts to
+        samples[i] = 1.0f - t;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,64 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Settings.h"
+
+namespace Luculentus
+{
+  /// A separable filter that spreads a photon over the pixels around
+  /// it, wider than a bilinear splat. The filter is sampled into a table
+  /// once, so evaluating it while plotting is a lookup.
+  class ReconstructionFilter
+  {
+    public:
+
+      /// The largest radius (in pixels) that a filter may have.
+      static const int maximumRadius = 8;
+
+      /// The number of samples of the filter between zero and its
+      /// radius.
+      static const int numberOfSamples = 256;
+
+      /// The distance from the centre (in pixels) beyond which the
+      /// filter is zero.
+      const float radius;
+
+      /// Samples the filter of the specified type and radius. The type
+      /// must not be Bilinear.
+      ReconstructionFilter(const Settings::Filter type, const float r);
+
+      /// Returns the weight of a pixel at the specified distance (in
+      /// pixels, along one axis) from the photon.
+      inline float operator()(const float distance) const
+      {
+        const int i = static_cast<int>(std::fabs(distance) * samplesPerPixel);
+        return samples[std::min(numberOfSamples - 1, i)];
+      }
+
+    private:
+
+      /// The number of samples per pixel of distance.
+      const float samplesPerPixel;
+
+      /// The weights at equal steps of distance, starting at zero.
+      std::vector<float> samples;
+  };
+}
@@ -35,3 +35,43 @@ Vector3 SRgb::Transform(Vector3 cie)
 
   return rgb;
 }
+
+Vector3 SRgb::ToConeResponse(const Vector3 cie)
+{
+  return MakeVector3( 0.8951f * cie.x + 0.2664f * cie.y - 0.1614f * cie.z,
+                     -0.7502f * cie.x + 1.7135f * cie.y + 0.0367f * cie.z,
+                      0.0389f * cie.x - 0.0685f * cie.y + 1.0296f * cie.z);
+}
+
+Vector3 SRgb::FromConeResponse(const Vector3 cone)
+{
+  return MakeVector3( 0.9869929f * cone.x - 0.1470543f * cone.y
+                     + 0.1599627f * cone.z,
+                      0.4323053f * cone.x + 0.5183603f * cone.y
+                     + 0.0492912f * cone.z,
+                     -0.0085287f * cone.x + 0.0400428f * cone.y
+                     + 0.9684867f * cone.z);
+}
+
+Matrix3 SRgb::GetWhiteBalance(const Vector3 white)
+{
+  // Scale the cone responses of the white to those of D65
+  const Vector3 d65 = ToConeResponse(MakeVector3(0.95047f, 1.0f, 1.08883f));
+  const Vector3 source = ToConeResponse(white);
+  const Vector3 gain = MakeVector3(d65.x / source.x, d65.y / source.y,
+                                   d65.z / source.z);
+
+  const auto adapt = [&](const Vector3 cie)
+  {
+    const Vector3 cone = ToConeResponse(cie);
+    return FromConeResponse(MakeVector3(cone.x * gain.x, cone.y * gain.y,
+                                        cone.z * gain.z));
+  };
+
+  // The columns are the images of the axes
+  const Vector3 ex = { 1.0f, 0.0f, 0.0f };
+  const Vector3 ey = { 0.0f, 1.0f, 0.0f };
+  const Vector3 ez = { 0.0f, 0.0f, 1.0f };
+  Matrix3 m = { adapt(ex), adapt(ey), adapt(ez) };
+  return m;
+}
@@ -17,6 +17,8 @@
 #pragma once
 
 #include <cmath>
+#include "FastMath.h"
+#include "Matrix3.h"
 #include "Vector3.h"
 
 namespace Luculentus
@@ -35,13 +37,23 @@ namespace Luculentus
         }
         else
         {
-          return 1.055f * std::pow(f, 1.0f / 2.4f) - 0.055f;
+          return 1.055f * FastMath::Pow(f, 1.0f / 2.4f) - 0.055f;
         }
       }
 
+      /// Converts a CIE XYZ tristimulus to the Bradford cone responses,
+      /// and back.
+      static Vector3 ToConeResponse(const Vector3 cie);
+      static Vector3 FromConeResponse(const Vector3 cone);
+
     public:
 
       /// Converts a CIE XYZ tristimulus to an sRGB colour
       static Vector3 Transform(Vector3 cie);
+
+      /// Returns the matrix that maps CIE XYZ tristimuli such that the
+      /// specified white (with a Y of 1) becomes the white point of
+      /// sRGB (D65), with the Bradford chromatic adaptation transform.
+      static Matrix3 GetWhiteBalance(const Vector3 white);
   };
 }
@@ -16,6 +16,9 @@
 
 #include "Scene.h"
 
+#include <algorithm>
+#include "MonteCarloUnit.h"
+
 using namespace Luculentus;
 
 const Object* Scene::Intersect(Ray ray, Intersection& intersection) const
@@ -42,3 +45,110 @@ const Object* Scene::Intersect(Ray ray, Intersection& intersection) const
 
   return object;
 }
+
+bool Scene::IsVisible(const Vector3 from, const Vector3 to) const
+{
+  Ray ray;
+  ray.direction = to - from;
+  const float distance = ray.direction.Magnitude();
+  ray.direction = ray.direction * (1.0f / distance);
+
+  // Displace the origin slightly, so the ray does not intersect the
+  // surface it starts on, and ignore intersections very close to the
+  // end point, which lies on a surface as well
+  ray.origin = from + ray.direction * 0.00001f;
+
+  Intersection intersection;
+  if (!Intersect(ray, intersection)) return true;
+  return intersection.distance >= distance * 0.9999f - 0.00002f;
+}
+
+void Scene::Compile()
+{
+  lights.clear();
+
+  // Evaluating the camera function is expensive, so do it only once for
+  // a number of points in time, and interpolate in between
+  cameras.clear();
+  for (int i = 0; i < numberOfCameras; i++)
+  {
+    cameras.push_back(GetCameraAtTime(static_cast<float>(i)
+                                      / (numberOfCameras - 1)));
+    cameras.back().Precompute();
+  }
+
+  for (size_t i = 0; i < objects.size(); i++)
+  {
+    if (objects[i].emissiveMaterial) lights.push_back(i);
+  }
+}
+
+Camera Scene::GetCamera(const float t) const
+{
+  const float f = t * (numberOfCameras - 1);
+  const int i = std::max(0, std::min(numberOfCameras - 2,
+                                     static_cast<int>(f)));
+
+  return Camera::Interpolate(cameras[i], cameras[i + 1], f - i);
+}
+
+float Scene::GetMaximumIntensity(const float wavelength) const
+{
+  float maximum = 0.0f;
+
+  for (auto i : lights)
+  {
+    maximum = std::max(maximum,
+                       objects[i].emissiveMaterial->GetIntensity(wavelength));
+  }
+
+  return maximum;
+}
+
+float Scene::GetTotalPower(const float wavelength) const
+{
+  float total = 0.0f;
+
+  for (auto i : lights)
+  {
+    const Object& light = objects[i];
+    total += light.surface->GetArea()
+           * light.emissiveMaterial->GetIntensity(wavelength);
+  }
+
+  return total;
+}
+
+bool Scene::SampleLight(const float wavelength, const float totalPower,
+                        MonteCarloUnit& monteCarloUnit,
+                        LightSample& sample) const
+{
+  if (totalPower <= 0.0f) return false;
+
+  // Pick a light with a probability proportional to its power
+  float u = monteCarloUnit.GetUnit() * totalPower;
+  const Object* light = nullptr;
+  float power = 0.0f;
+
+  for (auto i : lights)
+  {
+    light = &objects[i];
+    power = light->surface->GetArea()
+          * light->emissiveMaterial->GetIntensity(wavelength);
+    if (u < power) break;
+    u -= power;
+  }
+
+  // Rounding errors might let the loop end on a light without power
+  if (power <= 0.0f) return false;
+
+  // Then pick a point on it uniformly, so the probability per unit
+  // area is the power of the light divided by its area, divided by
+  // the total power
+  light->surface->SamplePoint(monteCarloUnit, sample.position,
+                              sample.normal);
+  sample.intensity = light->emissiveMaterial->GetIntensity(wavelength);
+  sample.probability = sample.intensity / totalPower;
+
+  return true;
+}
@@ -24,6 +24,24 @@
 
 namespace Luculentus
 {
+  class MonteCarloUnit;
+
+  /// A point sampled on one of the light sources.
+  struct LightSample
+  {
+    /// The position of the point.
+    Vector3 position;
+
+    /// The normal of the side of the surface that emits the light.
+    Vector3 normal;
+
+    /// The emitted radiance.
+    float intensity;
+
+    /// The probability density (per unit area) of picking the point.
+    float probability;
+  };
+
   class Scene
   {
     public:
@@ -31,14 +49,50 @@ namespace Luculentus
       /// All the renderable objects in the scene.
       std::vector<Object> objects;
 
+      /// The indices of the emissive objects, filled by Compile.
+      std::vector<size_t> lights;
+
       /// A function that returns the camera through which the scene
       /// will be seen. The function takes one parameter, the time (in
       /// the range 0.0  1.0), which will be sampled randomly to create
       /// effects like motion blur and zoom blur.
       std::function<Camera (const float)> GetCameraAtTime;
 
+      /// The number of cameras that Compile precomputes, at equal steps
+      /// in time.
+      static const int numberOfCameras = 256;
+
+      /// The cameras at equal steps in time, filled by Compile.
+      std::vector<Camera> cameras;
+
       /// Intersects the specified ray with the scene. If an object is
       /// intersected, it is returned, and the intersection is set.
       const Object* Intersect(Ray ray, Intersection& intersection) const;
+
+      /// Returns whether nothing blocks the line segment between the
+      /// two points.
+      bool IsVisible(const Vector3 from, const Vector3 to) const;
+
+      /// Prepares the scene for rendering, must be called after all
+      /// objects have been added and the camera function has been set.
+      void Compile();
+
+      /// Returns the camera at the specified time, interpolated between
+      /// the precomputed cameras.
+      Camera GetCamera(const float t) const;
+
+      /// Returns the intensity of the brightest light source in the
+      /// scene at the specified wavelength.
+      float GetMaximumIntensity(const float wavelength) const;
+
+      /// Returns the sum of the emitted power of all light sources that
+      /// can be sampled, at the specified wavelength.
+      float GetTotalPower(const float wavelength) const;
+
+      /// Picks a point on a light source, with a probability proportional
+      /// to the emitted power. Returns false if there is nothing to pick.
+      bool SampleLight(const float wavelength, const float totalPower,
+                       MonteCarloUnit& monteCarloUnit,
+                       LightSample& sample) const;
   };
 }
@@ -0,0 +1,197 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "ScreenDistribution.h"
+
+#include <algorithm>
+#include <numeric>
+#include "GatherUnit.h"
+#include "MonteCarloUnit.h"
+
+using namespace Luculentus;
+
+const float ScreenDistribution::uniformFraction = 0.2f;
+const float ScreenDistribution::maximumRelativeImportance = 16.0f;
+const double ScreenDistribution::minimumCount = 64.0;
+
+ScreenDistribution::ScreenDistribution(const int width, const int height)
+  : imageWidth(width)
+  , imageHeight(height)
+  , aspectRatio(static_cast<float>(width) / static_cast<float>(height))
+  , tilesX(GetNumberOfTiles(width))
+  , tilesY(GetNumberOfTiles(height))
+{
+  // Without any knowledge about the image, all tiles are equally
+  // important, which results in the uniform distribution.
+  Build(std::vector<float>(tilesX * tilesY, 0.0f));
+}
+
+ScreenDistribution::ScreenDistribution(const GatherUnit& gatherUnit)
+  : imageWidth(gatherUnit.imageWidth)
+  , imageHeight(gatherUnit.imageHeight)
+  , aspectRatio(static_cast<float>(imageWidth)
+              / static_cast<float>(imageHeight))
+  , tilesX(GetNumberOfTiles(imageWidth))
+  , tilesY(GetNumberOfTiles(imageHeight))
+{
+  std::vector<float> importance(tilesX * tilesY, 0.0f);
+  std::vector<bool> unknown(tilesX * tilesY, false);
+
+  for (int i = 0; i < tilesX * tilesY; i++)
+  {
+    const TileStatistics stats = gatherUnit.tileStatistics[i];
+
+    // Too few photons to say anything about the tile, it will be
+    // treated as one of the most important tiles.
+    if (stats.count < minimumCount)
+    {
+      unknown[i] = true;
+      continue;
+    }
+
+    // A tile that received no light at all has converged to black.
+    const double mean = stats.sum / stats.count;
+    if (mean <= 0.0) continue;
+
+    // The relative variance of a single photon. To reach the same
+    // relative error everywhere, every tile needs a number of photons
+    // proportional to it.
+    const double variance = stats.sumOfSquares / stats.count - mean * mean;
+    importance[i] = static_cast<float>(std::max(0.0, variance)
+                                       / (mean * mean));
+  }
+
+  // Cap the importance, relative to the average of the known tiles.
+  const int known = static_cast<int>(std::count(unknown.begin(),
+                                                unknown.end(), false));
+  const float total = std::accumulate(importance.begin(),
+                                      importance.end(), 0.0f);
+  const float cap = known > 0 && total > 0.0f
+                  ? total / known * maximumRelativeImportance
+                  : 1.0f;
+
+  for (int i = 0; i < tilesX * tilesY; i++)
+  {
+    importance[i] = unknown[i] ? cap : std::min(cap, importance[i]);
+  }
+
+  Build(importance);
+}
+
+void ScreenDistribution::Build(const std::vector<float>& importance)
+{
+  cumulativeProbability.resize(tilesX * tilesY);
+  weights.resize(tilesX * tilesY);
+
+  const float totalImportance = std::accumulate(importance.begin(),
+                                                importance.end(), 0.0f);
+
+  float cumulative = 0.0f;
+  for (int ty = 0; ty < tilesY; ty++)
+  {
+    for (int tx = 0; tx < tilesX; tx++)
+    {
+      const int i = ty * tilesX + tx;
+      const float area = GetTileArea(tx, ty);
+
+      // Mix the importance with the uniform distribution, so every
+      // tile can still be sampled, and the estimate remains unbiased.
+      const float probability = totalImportance > 0.0f
+        ? uniformFraction * area + (1.0f - uniformFraction)
+                                 * importance[i] / totalImportance
+        : area;
+
+      cumulative += probability;
+      cumulativeProbability[i] = cumulative;
+
+      // A uniformly distributed photon would land in the tile with a
+      // probability equal to its area; the weight corrects for that.
+      weights[i] = probability > 0.0f ? area / probability : 0.0f;
+    }
+  }
+
+  // Normalise to account for rounding errors.
+  for (auto& p : cumulativeProbability) p /= cumulative;
+}
+
+float ScreenDistribution::GetTileArea(const int tx, const int ty) const
+{
+  // The continuous pixel coordinates range from 0 to width - 1, the
+  // same mapping PlotUnit uses.
+  const float x0 = static_cast<float>(tx * tileSize);
+  const float y0 = static_cast<float>(ty * tileSize);
+  const float x1 = std::min<float>(x0 + tileSize, imageWidth - 1.0f);
+  const float y1 = std::min<float>(y0 + tileSize, imageHeight - 1.0f);
+
+  return (x1 - x0) * (y1 - y0)
+       / ((imageWidth - 1.0f) * (imageHeight - 1.0f));
+}
+
+float ScreenDistribution::Sample(MonteCarloUnit& monteCarloUnit,
+                                 float& x, float& y) const
+{
+  // Pick a tile with the probabilities of the distribution.
+  const float u = monteCarloUnit.GetUnit();
+  const int i = std::min<int>(tilesX * tilesY - 1, static_cast<int>(
+    std::upper_bound(cumulativeProbability.begin(),
+                     cumulativeProbability.end(), u)
+    - cumulativeProbability.begin()));
+  const int tx = i % tilesX;
+  const int ty = i / tilesX;
+
+  // Then pick a point uniformly inside the tile.
+  const float x0 = static_cast<float>(tx * tileSize);
+  const float y0 = static_cast<float>(ty * tileSize);
+  const float x1 = std::min<float>(x0 + tileSize, imageWidth - 1.0f);
+  const float y1 = std::min<float>(y0 + tileSize, imageHeight - 1.0f);
+  const float px = x0 + monteCarloUnit.GetUnit() * (x1 - x0);
+  const float py = y0 + monteCarloUnit.GetUnit() * (y1 - y0);
+
+  // Convert the pixel coordinates into screen coordinates.
+  x = px / (imageWidth - 1.0f) * 2.0f - 1.0f;
+  y = (py / (imageHeight - 1.0f) * 2.0f - 1.0f) / aspectRatio;
+
+  return weights[i];
+}
+
+float ScreenDistribution::GetWeight(const float x, const float y) const
+{
+  return weights[GetTile(x, y)];
+}
+
+int ScreenDistribution::GetTile(const float x, const float y) const
+{
+  // Convert the screen coordinates into pixel coordinates,
+  // and find the tile that contains them.
+  const float px = (x * 0.5f + 0.5f) * (imageWidth - 1.0f);
+  const float py = (y * aspectRatio * 0.5f + 0.5f) * (imageHeight - 1.0f);
+  const int tx = std::max(0, std::min(tilesX - 1,
+                                      static_cast<int>(px) / tileSize));
+  const int ty = std::max(0, std::min(tilesY - 1,
+                                      static_cast<int>(py) / tileSize));
+
+  return ty * tilesX + tx;
+}
+
+int ScreenDistribution::GetNumberOfTiles(const int width, const int height)
+{
+  return GetNumberOfTiles(width) * GetNumberOfTiles(height);
+}
+
+int ScreenDistribution::GetNumberOfTiles(const int size)
+{
+  return std::max(1, (size - 1 + tileSize - 1) / tileSize);
+}
@@ -0,0 +1,141 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vector>
+
+namespace Luculentus
+{
+  class GatherUnit;
+  class MonteCarloUnit;
+
+  /// Running sums of the luminance of all photons that were plotted
+  /// into one tile of the screen, from which the variance of the tile
+  /// can be estimated.
+  struct TileStatistics
+  {
+    /// The number of photons that landed in the tile.
+    double count;
+
+    /// The sum of the luminance (CIE Y) of the photons.
+    double sum;
+
+    /// The sum of the squared luminance of the photons.
+    double sumOfSquares;
+  };
+
+  inline TileStatistics& operator+=(TileStatistics& a,
+                                    const TileStatistics b)
+  {
+    a.count        += b.count;
+    a.sum          += b.sum;
+    a.sumOfSquares += b.sumOfSquares;
+    return a;
+  }
+
+  inline TileStatistics ZeroTileStatistics()
+  {
+    TileStatistics statistics = { 0.0, 0.0, 0.0 };
+    return statistics;
+  }
+
+  /// A probability distribution over the tiles of the screen, used to
+  /// spend more paths on the tiles where the relative error is high.
+  class ScreenDistribution
+  {
+    public:
+
+      /// The width and height of a tile (in pixels).
+      static const int tileSize = 16;
+
+      /// Width of the canvas (in pixels).
+      const int imageWidth;
+
+      /// Height of the canvas (in pixels).
+      const int imageHeight;
+
+      /// Width of the canvas divided by its height.
+      const float aspectRatio;
+
+      /// The number of tiles in horizontal direction.
+      const int tilesX;
+
+      /// The number of tiles in vertical direction.
+      const int tilesY;
+
+      /// The minimum number of photons in a tile before its variance
+      /// estimate is trusted.
+      static const double minimumCount;
+
+      /// Constructs a uniform distribution over a canvas
+      /// of the specified size.
+      ScreenDistribution(const int width, const int height);
+
+      /// Constructs a distribution that favours the tiles with the
+      /// highest estimated relative error in the GatherUnit.
+      ScreenDistribution(const GatherUnit& gatherUnit);
+
+      /// Picks a screen position (in the same coordinates as
+      /// MappedPhoton), and returns the weight by which the photon must
+      /// be multiplied to compensate for the non-uniform probability.
+      float Sample(MonteCarloUnit& monteCarloUnit,
+                   float& x, float& y) const;
+
+      /// Returns the weight that Sample would return for a photon at the
+      /// specified screen position.
+      float GetWeight(const float x, const float y) const;
+
+      /// Returns the index of the tile that contains the specified
+      /// screen position (which is clamped to the screen).
+      int GetTile(const float x, const float y) const;
+
+      /// Returns the number of tiles needed to cover a canvas
+      /// of the specified size.
+      static int GetNumberOfTiles(const int width, const int height);
+
+      /// Returns the number of tiles along an edge of the specified
+      /// number of pixels. The continuous pixel coordinates range from
+      /// 0 to size - 1, so a tile starting at the last pixel would have
+      /// no area; the last pixel belongs to the tile before it.
+      static int GetNumberOfTiles(const int size);
+
+    private:
+
+      /// The fraction of paths distributed uniformly, which guarantees
+      /// that every tile keeps a non-zero probability.
+      static const float uniformFraction;
+
+      /// The maximum importance of a tile, relative to the average
+      /// importance, so a few tiles with fireflies cannot starve the
+      /// rest of the image.
+      static const float maximumRelativeImportance;
+
+      /// The cumulative probability of all tiles up to and including
+      /// the tile at the index.
+      std::vector<float> cumulativeProbability;
+
+      /// The factor by which a photon in a tile must be weighted.
+      std::vector<float> weights;
+
+      /// Fills the tables for the specified (unnormalised) importance
+      /// per tile.
+      void Build(const std::vector<float>& importance);
+
+      /// Returns the fraction of the canvas covered by the tile.
+      float GetTileArea(const int tx, const int ty) const;
+  };
+}
@@ -0,0 +1,192 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "Settings.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using namespace Luculentus;
+
+Settings::Settings()
+  : integrator(PathTracing)
+  , filter(Bilinear)
+  , filterRadius(2.0f)
+  , spectralBands(0)
+  , observer(TwoDegreeObserver)
+  , whiteBalance(0.0f)
+  , adaptiveSampling(true)
+  , pathGuiding(true)
+  , radianceCache(false)
+  , pathSplits(1)
+  , adaptiveSplitting(true)
+  , fusedPlotting(false)
+  , packedPhotons(false)
+  , sharedFilm(false)
+  , pinThreads(false)
+  , spinTime(0)
+  , batchSize(0)
+  , taskTime(1.0)
+  , traceUnits(0)
+  , plotUnits(0)
+  , memoryBudget(0)
+  , noiseThreshold(0.0f)
+  , maximumSamples(0)
+  , timeLimit(0.0)
+{
+
+}
+
+bool Settings::HasStoppingCriterion() const
+{
+  return noiseThreshold > 0.0f || maximumSamples > 0 || timeLimit > 0.0;
+}
+
+Settings Luculentus::ParseSettings(int argc, char** argv)
+{
+  Settings settings;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string argument = argv[i];
+
+    // Split the argument into the name and the value.
+    const size_t equals = argument.find('=');
+    const std::string name = argument.substr(0, equals);
+    const std::string value = equals == std::string::npos
+                            ? "" : argument.substr(equals + 1);
+
+    if (name == "--integrator")
+    {
+      if (value == "path")
+        settings.integrator = Settings::PathTracing;
+      else if (value == "bidirectional" || value == "bdpt")
+        settings.integrator = Settings::BidirectionalPathTracing;
+      else if (value == "photon" || value == "ppm")
+        settings.integrator = Settings::ProgressivePhotonMapping;
+      else if (value == "metropolis" || value == "mlt")
+        settings.integrator = Settings::MetropolisLightTransport;
+      else
+        std::cerr << "warning: unknown integrator " << value << std::endl;
+    }
+    else if (name == "--filter")
+    {
+      if (value == "bilinear")
+        settings.filter = Settings::Bilinear;
+      else if (value == "gaussian")
+        settings.filter = Settings::Gaussian;
+      else if (value == "mitchell")
+        settings.filter = Settings::Mitchell;
+      else if (value == "blackman-harris")
+        settings.filter = Settings::BlackmanHarris;
+      else
+        std::cerr << "warning: unknown filter " << value << std::endl;
+    }
+    else if (name == "--filter-radius")
+      settings.filterRadius = std::max(0.5f, std::min(8.0f,
+        static_cast<float>(std::atof(value.c_str()))));
+    else if (name == "--spectral-bands")
+      settings.spectralBands = std::max(0, std::min(
+        static_cast<int>(Settings::maximumSpectralBands),
+        std::atoi(value.c_str())));
+    else if (name == "--observer")
+    {
+      if (value == "1931")
+        settings.observer = Settings::TwoDegreeObserver;
+      else if (value == "1964")
+        settings.observer = Settings::TenDegreeObserver;
+      else
+        std::cerr << "warning: unknown observer " << value << std::endl;
+    }
+    else if (name == "--white-balance")
+      settings.whiteBalance = std::max(0.0f,
+        static_cast<float>(std::atof(value.c_str())));
+    else if (name == "--no-adaptive-sampling")
+      settings.adaptiveSampling = false;
+    else if (name == "--no-path-guiding")
+      settings.pathGuiding = false;
+    else if (name == "--radiance-cache")
+      settings.radianceCache = true;
+    else if (name == "--path-splits")
+      settings.pathSplits = std::max(1, std::atoi(value.c_str()));
+    else if (name == "--no-adaptive-splitting")
+      settings.adaptiveSplitting = false;
+    else if (name == "--fused-plotting")
+      settings.fusedPlotting = true;
+    else if (name == "--packed-photons")
+      settings.packedPhotons = true;
+    else if (name == "--shared-film")
+      settings.sharedFilm = true;
+    else if (name == "--pin-threads")
+      settings.pinThreads = true;
+    else if (name == "--spin-time")
+      settings.spinTime = std::max(0, std::atoi(value.c_str()));
+    else if (name == "--batch-size")
+      settings.batchSize = std::max(0, std::atoi(value.c_str()));
+    else if (name == "--task-time")
+      settings.taskTime = std::max(0.01, std::atof(value.c_str()));
+    else if (name == "--trace-units")
+      settings.traceUnits = std::max(0, std::atoi(value.c_str()));
+    else if (name == "--plot-units")
+      settings.plotUnits = std::max(0, std::atoi(value.c_str()));
+    else if (name == "--memory-budget")
+      settings.memoryBudget = std::max(0, std::atoi(value.c_str()));
+    else if (name == "--noise-threshold")
+      settings.noiseThreshold = static_cast<float>(std::atof(value.c_str()));
+    else if (name == "--max-samples")
+      settings.maximumSamples = std::strtoull(value.c_str(), nullptr, 10);
+    else if (name == "--time-limit")
+      settings.timeLimit = std::atof(value.c_str());
+    else if (name == "--output")
+      settings.outputFile = value;
+    else if (name == "--save-film")
+      settings.filmOutputFile = value;
+    else if (name == "--load-film")
+      settings.filmInputFile = value;
+  }
+
+  // Only spectra can be written to a film
+  if (!settings.filmOutputFile.empty() && settings.spectralBands == 0)
+    settings.spectralBands = Settings::defaultSpectralBands;
+
+  // The shared film stores tristimulus values only
+  if (settings.spectralBands > 0 && settings.sharedFilm)
+  {
+    std::cerr << "warning: the shared film cannot record spectra, "
+              << "so it is not used" << std::endl;
+    settings.sharedFilm = false;
+  }
+
+  // Without spectra, the tristimulus values are those of the 2 degree
+  // observer already
+  if (settings.observer != Settings::TwoDegreeObserver
+      && settings.spectralBands == 0 && settings.filmInputFile.empty())
+  {
+    std::cerr << "warning: the observer can only be changed when spectra "
+              << "are recorded (--spectral-bands)" << std::endl;
+    settings.observer = Settings::TwoDegreeObserver;
+  }
+
+  if (!settings.outputFile.empty() && !settings.HasStoppingCriterion()
+      && settings.filmInputFile.empty())
+  {
+    std::cerr << "warning: an output file was specified, but no stopping "
+              << "criterion, so the image is never written" << std::endl;
+  }
+
+  return settings;
+}
@@ -0,0 +1,195 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+
+namespace Luculentus
+{
+  /// Options that control how the image is rendered, and when rendering
+  /// is done. They can be set on the command line.
+  struct Settings
+  {
+    /// The algorithms that can compute the light arriving at the camera.
+    enum Integrator
+    {
+      /// Traces paths from the camera until they hit a light source.
+      PathTracing,
+
+      /// Traces paths from both the camera and the light sources, and
+      /// connects them.
+      BidirectionalPathTracing,
+
+      /// Traces photons from the light sources, and estimates the light
+      /// at the first diffuse surface seen by the camera from the
+      /// photons nearby.
+      ProgressivePhotonMapping,
+
+      /// Explores the space of camera paths with a Markov chain, which
+      /// stays near bright paths once it found them.
+      MetropolisLightTransport
+    };
+
+    /// The algorithm used to render the image.
+    Integrator integrator;
+
+    /// The filters that can reconstruct the image from the photons.
+    enum Filter
+    {
+      /// Spreads a photon over the four nearest pixels.
+      Bilinear,
+
+      /// A Gaussian, with a standard deviation of a third of its radius.
+      Gaussian,
+
+      /// The cubic filter of Mitchell and Netravali (B = C = 1/3), which
+      /// is sharper than a Gaussian, but rings slightly.
+      Mitchell,
+
+      /// The Blackman-Harris window, which is nearly as smooth as a
+      /// Gaussian, and falls off to zero more gracefully.
+      BlackmanHarris
+    };
+
+    /// The filter used to plot photons.
+    Filter filter;
+
+    /// The radius of the filter (in pixels), unless it is bilinear.
+    float filterRadius;
+
+    /// The number of bands of equal width that the visible spectrum is
+    /// divided into, when plot units record light per band instead of
+    /// as tristimulus values. Zero means no spectra are recorded.
+    int spectralBands;
+
+    /// The observers that spectra can be converted to tristimulus
+    /// values for.
+    enum Observer
+    {
+      /// The CIE 1931 2 degree standard observer.
+      TwoDegreeObserver,
+
+      /// The CIE 1964 10 degree supplementary standard observer.
+      TenDegreeObserver
+    };
+
+    /// The observer whose colour matching functions are used.
+    Observer observer;
+
+    /// The colour temperature (in K) of the light that should appear
+    /// white in the image. Zero means the image is not white balanced.
+    float whiteBalance;
+
+    /// Whether to spend more paths on noisy parts of the image.
+    bool adaptiveSampling;
+
+    /// Whether path tracing learns where light comes from, and sends
+    /// paths in those directions at diffuse surfaces.
+    bool pathGuiding;
+
+    /// Whether path tracing ends paths in a cache of reflected light
+    /// after their first diffuse bounce. This is much faster, but the
+    /// image does not converge to the exact solution.
+    bool radianceCache;
+
+    /// The number of directions in which path tracing continues a path
+    /// from the first diffuse surface it hits, sharing the camera ray.
+    int pathSplits;
+
+    /// Whether paths that carry little light are split less.
+    bool adaptiveSplitting;
+
+    /// Whether trace tasks plot their photons directly, instead of
+    /// leaving them for plot tasks.
+    bool fusedPlotting;
+
+    /// Whether trace units store their photons in 8 bytes instead of
+    /// 16, at the cost of some precision.
+    bool packedPhotons;
+
+    /// Whether all plot units plot into a single shared canvas, instead
+    /// of a canvas each that must be gathered.
+    bool sharedFilm;
+
+    /// Whether every worker thread is restricted to its own processor,
+    /// so the buffers it touched first stay close to it.
+    bool pinThreads;
+
+    /// The number of microseconds that a worker without work keeps
+    /// checking for it, before it waits to be woken.
+    int spinTime;
+
+    /// The number of paths per trace task. Zero means the batch size is
+    /// adjusted while rendering, so that tasks take about taskTime.
+    int batchSize;
+
+    /// The number of seconds a trace task should take, when the batch
+    /// size is adjusted while rendering.
+    double taskTime;
+
+    /// The number of trace units and plot units. Zero means a number
+    /// based on the number of threads and the memory budget.
+    int traceUnits;
+    int plotUnits;
+
+    /// The memory (in MB) that the buffers of all units together may
+    /// use. The settings that are not set explicitly are chosen to fit.
+    /// Zero means half of the memory that the process may use.
+    int memoryBudget;
+
+    /// Rendering stops once the estimated relative error of the image
+    /// drops below this value. Zero means no threshold.
+    float noiseThreshold;
+
+    /// Rendering stops once this many paths have been traced.
+    /// Zero means no limit.
+    unsigned long long maximumSamples;
+
+    /// Rendering stops after this many seconds. Zero means no limit.
+    double timeLimit;
+
+    /// The file the final image is written to (as binary PPM) once
+    /// rendering is done. Empty means the image is not written.
+    std::string outputFile;
+
+    /// The file the spectra of the film are written to once rendering
+    /// is done. Empty means the film is not written.
+    std::string filmOutputFile;
+
+    /// A film written before, that is tonemapped again instead of
+    /// rendering. Empty means the image is rendered.
+    std::string filmInputFile;
+
+    /// The number of spectral bands when spectra are required, but no
+    /// number of bands was specified.
+    static const int defaultSpectralBands = 16;
+
+    /// The largest number of spectral bands.
+    static const int maximumSpectralBands = 64;
+
+    /// Constructs the default settings, which render until the window
+    /// is closed.
+    Settings();
+
+    /// Returns whether any of the stopping criteria is set.
+    bool HasStoppingCriterion() const;
+  };
+
+  /// Reads settings of the form --name=value from the command line.
+  /// Unknown arguments are left for the user interface toolkit.
+  Settings ParseSettings(int argc, char** argv);
+}
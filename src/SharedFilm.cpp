@@ -0,0 +1,75 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "SharedFilm.h"
+
+#include <algorithm>
+#include "GatherUnit.h"
+#include "Platform.h"
+
+using namespace Luculentus;
+
+SharedFilm::SharedFilm(const int width, const int height)
+  : imageWidth(width)
+  , imageHeight(height)
+  , regionsX((width + regionSize - 1) / regionSize)
+  , regionsY((height + regionSize - 1) / regionSize)
+  , tileStatistics(ScreenDistribution::GetNumberOfTiles(width, height),
+                   ZeroTileStatistics())
+  , locks(regionsX * regionsY)
+{
+  AllocateBuffer(tristimulusBuffer, width * height, ZeroVector3());
+  for (auto& lock : locks) lock.store(false);
+}
+
+void SharedFilm::DrainInto(GatherUnit& gatherUnit)
+{
+  const int tilesPerRegion = regionSize / ScreenDistribution::tileSize;
+  const int tilesX = ScreenDistribution::GetNumberOfTiles(imageWidth);
+  const int tilesY = ScreenDistribution::GetNumberOfTiles(imageHeight);
+
+  for (int r = 0; r < regionsX * regionsY; r++)
+  {
+    const int x0 = (r % regionsX) * regionSize;
+    const int y0 = (r / regionsX) * regionSize;
+    const int x1 = std::min(imageWidth, x0 + regionSize);
+    const int y1 = std::min(imageHeight, y0 + regionSize);
+    const int tx0 = (r % regionsX) * tilesPerRegion;
+    const int ty0 = (r / regionsX) * tilesPerRegion;
+    const int tx1 = std::min(tilesX, tx0 + tilesPerRegion);
+    const int ty1 = std::min(tilesY, ty0 + tilesPerRegion);
+
+    Lock(r);
+
+    for (int y = y0; y < y1; y++)
+    {
+      gatherUnit.AccumulatePixels(&tristimulusBuffer[0],
+                                  y * imageWidth + x0, y * imageWidth + x1);
+    }
+
+    for (int ty = ty0; ty < ty1; ty++)
+    {
+      for (int tx = tx0; tx < tx1; tx++)
+      {
+        gatherUnit.tileStatistics[ty * tilesX + tx] +=
+          tileStatistics[ty * tilesX + tx];
+        tileStatistics[ty * tilesX + tx] = ZeroTileStatistics();
+      }
+    }
+
+    Unlock(r);
+  }
+}
@@ -0,0 +1,91 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "ScreenDistribution.h"
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  class GatherUnit;
+
+  /// A canvas that all plot units plot into directly, instead of into a
+  /// canvas of their own that must be gathered. The canvas is divided
+  /// into square regions with a spin lock each, and a plot unit holds
+  /// the locks of the regions it writes to.
+  class SharedFilm
+  {
+    public:
+
+      /// The width and height of a region (in pixels). It must be a
+      /// multiple of the tile size of the screen distribution, so the
+      /// statistics of a tile are guarded by a single lock.
+      static const int regionSize = 32;
+
+      /// Width of the canvas (in pixels).
+      const int imageWidth;
+
+      /// Height of the canvas (in pixels).
+      const int imageHeight;
+
+      /// The number of regions in horizontal and vertical direction.
+      const int regionsX, regionsY;
+
+      /// The buffer of tristimulus values plotted since the last gather.
+      std::vector<Vector3> tristimulusBuffer;
+
+      /// Statistics about the photons plotted into every tile since the
+      /// last gather.
+      std::vector<TileStatistics> tileStatistics;
+
+      /// Constructs a black canvas of the specified size.
+      SharedFilm(const int width, const int height);
+
+      /// Acquires the lock of the region, waiting until other threads
+      /// release it. Locks of multiple regions must be acquired in
+      /// increasing order.
+      inline void Lock(const int region)
+      {
+        // Spin on a plain load, which does not take the cache line away
+        // from the thread that holds the lock
+        while (locks[region].exchange(true, std::memory_order_acquire))
+        {
+          while (locks[region].load(std::memory_order_relaxed)) { }
+        }
+      }
+
+      /// Releases the lock of the region.
+      inline void Unlock(const int region)
+      {
+        locks[region].store(false, std::memory_order_release);
+      }
+
+      /// Adds the canvas and statistics of the film to those of the
+      /// gather unit, and clears them, region by region, while plot
+      /// units continue to plot into the other regions. The film itself
+      /// only ever holds a few batches of photons, so the gather unit
+      /// can compensate its sums for the low-order bits.
+      void DrainInto(GatherUnit& gatherUnit);
+
+    private:
+
+      /// Whether a thread holds the region, per region.
+      std::vector<std::atomic<bool>> locks;
+  };
+}
@@ -0,0 +1,32 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+namespace Luculentus
+{
+  /// Hashes the integer coordinates of a grid cell, so that a grid of
+  /// unbounded extent can be stored in a table of fixed size. See
+  /// "Optimized Spatial Hashing for Collision Detection of Deformable
+  /// Objects" (Teschner et al., 2003).
+  inline unsigned int HashCell(const int x, const int y, const int z)
+  {
+    return (static_cast<unsigned int>(x) * 73856093u)
+         ^ (static_cast<unsigned int>(y) * 19349663u)
+         ^ (static_cast<unsigned int>(z) * 83492791u);
+  }
+}
@@ -0,0 +1,64 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "SpectralBands.h"
+
+#include "Cie1931.h"
+#include "Cie1964.h"
+
+using namespace Luculentus;
+
+const float SpectralBands::minimumWavelength = 380.0f;
+const float SpectralBands::maximumWavelength = 780.0f;
+
+SpectralBands::SpectralBands(const int bands)
+  : numberOfBands(bands)
+  , bandsPerNm(bands / (maximumWavelength - minimumWavelength))
+{
+
+}
+
+std::vector<Vector3> SpectralBands::GetTristimuli(
+  const Settings::Observer observer) const
+{
+  // Average over a few samples per nm, the colour matching functions
+  // are tabulated at 5 nm steps and are piecewise linear between them
+  const int samplesPerBand = std::max(1, static_cast<int>(4.0f / bandsPerNm));
+  std::vector<Vector3> tristimuli(numberOfBands, ZeroVector3());
+
+  for (int band = 0; band < numberOfBands; band++)
+  {
+    for (int i = 0; i < samplesPerBand; i++)
+    {
+      const float wavelength = minimumWavelength
+                             + (band + (i + 0.5f) / samplesPerBand)
+                             / bandsPerNm;
+      tristimuli[band] += GetTristimulus(observer, wavelength);
+    }
+    tristimuli[band] = tristimuli[band] * (1.0f / samplesPerBand);
+  }
+
+  return tristimuli;
+}
+
+Vector3 SpectralBands::GetTristimulus(const Settings::Observer observer,
+                                      const float wavelength)
+{
+  if (observer == Settings::TenDegreeObserver)
+    return Cie1964::GetTristimulus(wavelength);
+  else
+    return Cie1931::GetTristimulus(wavelength);
+}
@@ -0,0 +1,68 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "Settings.h"
+#include "Vector3.h"
+
+namespace Luculentus
+{
+  /// Divides the visible spectrum into bands of equal width. Light can
+  /// be recorded per band while rendering, and converted to tristimulus
+  /// values afterwards, for any observer.
+  class SpectralBands
+  {
+    public:
+
+      /// The range of wavelengths (in nm) that paths are traced at.
+      static const float minimumWavelength;
+      static const float maximumWavelength;
+
+      /// The number of bands.
+      const int numberOfBands;
+
+      /// Divides the spectrum into the specified number of bands.
+      SpectralBands(const int bands);
+
+      /// Returns the band that contains the wavelength (in nm).
+      inline int GetBand(const float wavelength) const
+      {
+        const int band = static_cast<int>((wavelength - minimumWavelength)
+                                          * bandsPerNm);
+        return std::max(0, std::min(numberOfBands - 1, band));
+      }
+
+      /// Returns for every band the tristimulus value of light in it, for
+      /// the observer. Paths are traced at uniformly distributed
+      /// wavelengths, so that is the average over the band of the
+      /// tristimulus values of the wavelengths in it.
+      std::vector<Vector3> GetTristimuli(const Settings::Observer observer)
+                                         const;
+
+      /// Returns the tristimulus value of the wavelength (in nm) for the
+      /// observer.
+      static Vector3 GetTristimulus(const Settings::Observer observer,
+                                    const float wavelength);
+
+    private:
+
+      /// The number of bands per nm, the reciprocal of their width.
+      const float bandsPerNm;
+  };
+}
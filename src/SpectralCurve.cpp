@@ -0,0 +1,34 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "SpectralCurve.h"
+
+using namespace Luculentus;
+
+const float SpectralCurve::minimumWavelength = 380.0f;
+const float SpectralCurve::maximumWavelength = 780.0f;
+const float SpectralCurve::samplesPerNm = (numberOfSamples - 1)
+                                         / (780.0f - 380.0f);
+
+SpectralCurve::SpectralCurve(
+  const std::function<float (const float)>& function)
+  : samples(numberOfSamples)
+{
+  for (int i = 0; i < numberOfSamples; i++)
+  {
+    samples[i] = function(minimumWavelength + i / samplesPerNm);
+  }
+}
@@ -0,0 +1,63 @@
+// Luculentus -- Proof of concept spectral path tracer
+// Copyright (C) 2014  Ruud van Asseldonk
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace Luculentus
+{
+  /// A function of wavelength, sampled at equal steps over the visible
+  /// spectrum. Expensive curves (such as Planck's law, or a Sellmeier
+  /// equation) are evaluated once when the curve is constructed, after
+  /// which evaluating the curve is a lookup and a linear interpolation.
+  class SpectralCurve
+  {
+    public:
+
+      /// The number of samples over the visible spectrum.
+      static const int numberOfSamples = 512;
+
+      /// The range of wavelengths (in nm) that is sampled. Beyond it,
+      /// the curve is extended with its value at the nearest end.
+      static const float minimumWavelength;
+      static const float maximumWavelength;
+
+      /// Samples the function, which takes a wavelength in nm.
+      SpectralCurve(const std::function<float (const float)>& function);
+
+      /// Returns the (interpolated) value at the specified wavelength.
+      inline float operator()(const float wavelength) const
+      {
+        const float f = (wavelength - minimumWavelength) * samplesPerNm;
+        const int i = std::max(0, std::min(numberOfSamples - 2,
+                                           static_cast<int>(f)));
+        const float t = std::max(0.0f, std::min(1.0f, f - i));
+        return samples[i] + (samples[i + 1] - samples[i]) * t;
+      }
+
+    private:
+
+      /// The number of samples per nm, the reciprocal of the step.
+      static const float samplesPerNm;
+
+      /// The values of the function at equal steps, including both ends
+      /// of the range.
+      std::vector<float> samples;
+  };
+}
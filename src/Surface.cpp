@@ -16,10 +16,25 @@
 
 #include "Surface.h"
 
+#include <algorithm>
 #include "MonteCarloUnit.h"
+#include "Constants.h"
 
 using namespace Luculentus;
 
+float Surface::GetArea() const
+{
+  // Surfaces can not be sampled by default
+  return 0.0f;
+}
+
+void Surface::SamplePoint(MonteCarloUnit&, Vector3&, Vector3&) const
+{
+  // Only surfaces with an area can be sampled, this should not happen
+}
+
+// --------------------
+
 Plane::Plane(const Vector3 n, const Vector3 o)
   : normal(n)
   , offset(o) { }
@@ -107,6 +122,27 @@ bool Circle::Intersect(const Ray ray, Intersection& intersection) const
   return false;
 }
 
+float Circle::GetArea() const
+{
+  // Both sides count, because the circle is two-sided
+  return static_cast<float>(pi) * radiusSquared * 2.0f;
+}
+
+void Circle::SamplePoint(MonteCarloUnit& monteCarloUnit,
+                         Vector3& pointPosition, Vector3& pointNormal) const
+{
+  // Pick polar coordinates uniformly distributed over the disk
+  const float phi = monteCarloUnit.GetLongitude();
+  const float r = std::sqrt(monteCarloUnit.GetUnit()) * radius;
+  const Vector3 p = { std::cos(phi) * r, std::sin(phi) * r, 0.0f };
+
+  // Then rotate the disk into the plane of the circle
+  pointPosition = offset + RotateTowards(p, normal);
+
+  // And pick one of the sides
+  pointNormal = monteCarloUnit.GetUnit() < 0.5f ? normal : -normal;
+}
+
 // --------------------
 
 Sphere::Sphere(const Vector3 p, const float r)
@@ -157,6 +193,24 @@ bool Sphere::LiesInside(const Vector3 x) const
   return (x - position).MagnitudeSquared() < radiusSquared;
 }
 
+float Sphere::GetArea() const
+{
+  return static_cast<float>(pi) * radiusSquared * 4.0f;
+}
+
+void Sphere::SamplePoint(MonteCarloUnit& monteCarloUnit,
+                         Vector3& pointPosition, Vector3& pointNormal) const
+{
+  // A uniformly distributed direction: the height along the z-axis is
+  // uniformly distributed for a sphere (Archimedes' hat-box theorem)
+  const float phi = monteCarloUnit.GetLongitude();
+  const float z = monteCarloUnit.GetBiUnit();
+  const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+
+  pointNormal = MakeVector3(std::cos(phi) * r, std::sin(phi) * r, z);
+  pointPosition = position + pointNormal * std::sqrt(radiusSquared);
+}
+
 bool Sphere::GetIntersections(const Vector3 spherePosition,
                               const float sphereRadiusSquared,
                               const Vector3 rayOrigin,
@@ -23,6 +23,8 @@
 
 namespace Luculentus
 {
+  class MonteCarloUnit;
+
   class Surface
   {
     public:
@@ -30,6 +32,16 @@ namespace Luculentus
       /// Returns whether the surface was intersected, and if so, where.
       virtual bool Intersect(const Ray ray,
                              Intersection& intersection) const = 0;
+
+      /// Returns the area of the surface, where both sides of open
+      /// surfaces count. Surfaces on which no point can be picked
+      /// return 0; lights with such a surface can only be hit by chance.
+      virtual float GetArea() const;
+
+      /// Picks a uniformly distributed point on (one side of) the
+      /// surface, and returns the position and the normal of that side.
+      virtual void SamplePoint(MonteCarloUnit& monteCarloUnit,
+                               Vector3& position, Vector3& normal) const;
   };
 
   class Plane : public Surface
@@ -88,6 +100,11 @@ namespace Luculentus
 
       virtual bool Intersect(const Ray ray,
                              Intersection& intersection) const;
+
+      virtual float GetArea() const;
+
+      virtual void SamplePoint(MonteCarloUnit& monteCarloUnit,
+                               Vector3& position, Vector3& normal) const;
   };
 
   class Sphere : public Surface, public Volume
@@ -110,6 +127,11 @@ namespace Luculentus
 
       virtual bool LiesInside(const Vector3 x) const;
 
+      virtual float GetArea() const;
+
+      virtual void SamplePoint(MonteCarloUnit& monteCarloUnit,
+                               Vector3& position, Vector3& normal) const;
+
       /// Returns whether a ray intersects a sphere, and if it does,
       /// it returns the distances along the ray in t1 and t2
       static bool GetIntersections(const Vector3 spherePosition,
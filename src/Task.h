@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <vector>
 
 namespace Luculentus
@@ -39,13 +40,22 @@ namespace Luculentus
       Tonemap
     }
     /// The type of thing that should be done.
-    type;
+    type = Sleep;
 
     /// The index of the unit to use to execute the task (for trace and plot tasks).
-    int unit;
+    /// For gather tasks, the part of the canvas to gather.
+    int unit = 0;
 
     /// The units that should be processed, e.g. for a Plot task, this
-    /// contains the indices of the TraceUnits that must be plotted.
+    /// contains the indices of the TraceUnits that must be plotted. For
+    /// a Trace task that plots its own photons, it contains the index
+    /// of the PlotUnit to plot into.
     std::vector<int> otherUnits;
+
+    /// The number of paths to trace (for trace tasks).
+    int numberOfPaths = 0;
+
+    /// The time at which the task was handed out (for trace tasks).
+    std::chrono::steady_clock::time_point startTime = {};
   };
 }
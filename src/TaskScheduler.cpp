@@ -16,8 +16,11 @@
 
 #include "TaskScheduler.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include <numeric>
+#include <thread>
+#include "Platform.h"
 
 using namespace Luculentus;
 using std::chrono::steady_clock;
@@ -26,66 +29,392 @@ using std::chrono::duration_cast;
 const steady_clock::duration TaskScheduler::tonemappingInterval = std::chrono::seconds(30);
 
 TaskScheduler::TaskScheduler(const int numberOfThreads, const int width,
-                             const int height, const Scene& scene)
+                             const int height, const Scene& scene,
+                             const Settings& renderSettings)
+  : workerQueues(std::max(1, numberOfThreads))
+  , settings(renderSettings)
 {
-  // More trace units than threads seems sensible,
-  // but less plot units is acceptable,
-  // because one plot unit can handle multiple trace units
-  numberOfTraceUnits = std::max(1, numberOfThreads * 3);
+  // More trace units than threads keep every thread tracing while
+  // others wait to be plotted. Their photons are plotted soon after
+  // they are traced, so the waiting ones can stay in the last level
+  // cache: take as many extra trace units as it holds buffers for, up
+  // to two per thread. Less plot units is acceptable, because one plot
+  // unit can handle multiple trace units; the memory budget below
+  // takes away what does not fit.
+  const size_t traceBufferSize =
+    TraceUnit::GetNumberOfBufferedPhotons() * sizeof(MappedPhoton);
+  const int cachedTraceUnits =
+    static_cast<int>(GetCacheSize(3) / traceBufferSize);
+  numberOfTraceUnits = std::max(1, numberOfThreads
+    + std::max(1, std::min(numberOfThreads * 2, cachedTraceUnits)));
   numberOfPlotUnits  = std::max(1, numberOfThreads / 2);
 
+  // When tracing plots its own photons, trace units are never left
+  // waiting for a plot, and every thread needs a plot unit to trace
+  if (settings.fusedPlotting)
+  {
+    numberOfTraceUnits = std::max(1, numberOfThreads);
+    numberOfPlotUnits  = std::max(1, numberOfThreads);
+  }
+
+  // Every thread can gather a strip of the canvas
+  numberOfGatherParts = std::max(1, std::min(numberOfThreads, height));
+
+  if (settings.traceUnits > 0) numberOfTraceUnits = settings.traceUnits;
+  if (settings.plotUnits > 0) numberOfPlotUnits = settings.plotUnits;
+
+  maximumBatchSize = settings.batchSize > 0 ? settings.batchSize
+                                            : TraceUnit::defaultBatchSize;
+
+  // All buffers must fit in the memory budget. If they do not, give up
+  // what costs the least performance first: trace units beyond one per
+  // thread, then photon precision, plot units beyond one, the
+  // compensation of the gathered sums, and finally long batches.
+  // Whatever is set explicitly is left alone.
+  size_t budget = static_cast<size_t>(settings.memoryBudget) * 1024 * 1024;
+  if (budget == 0) budget = GetMemorySize() / 2;
+  if (budget == 0) budget = static_cast<size_t>(1024) * 1024 * 1024;
+  packPhotons = settings.packedPhotons && !settings.fusedPlotting;
+  compensateGather = true;
+
+  const size_t minimumTraceUnits = std::max(1, numberOfThreads);
+  while (settings.traceUnits == 0 && numberOfTraceUnits > minimumTraceUnits
+         && GetFootprint(width, height) > budget)
+    numberOfTraceUnits--;
+  if (!settings.fusedPlotting && !packPhotons
+      && GetFootprint(width, height) > budget)
+    packPhotons = true;
+  while (settings.plotUnits == 0 && numberOfPlotUnits > 1
+         && GetFootprint(width, height) > budget)
+    numberOfPlotUnits--;
+  if (GetFootprint(width, height) > budget) compensateGather = false;
+  while (settings.batchSize == 0 && maximumBatchSize > minimumBatchSize
+         && GetFootprint(width, height) > budget)
+  {
+    maximumBatchSize = maximumBatchSize / 4 * 3;
+    if (maximumBatchSize < minimumBatchSize)
+      maximumBatchSize = minimumBatchSize;
+  }
+
+  // Start with small batches, so the first image appears soon; they
+  // grow once the time per path is known
+  batchSize = settings.batchSize > 0
+            ? settings.batchSize
+            : std::min(maximumBatchSize, minimumBatchSize * 4);
+  secondsPerPath = 0.0;
+
+  std::cout << "using " << numberOfTraceUnits << " trace units"
+            << (packPhotons ? " with packed photons" : "") << " and "
+            << numberOfPlotUnits << " plot units, with batches of up to "
+            << maximumBatchSize << " paths" << std::endl;
+  if (!compensateGather)
+    std::cout << "gathering without compensation, to save memory"
+              << std::endl;
+
+  const size_t megabyte = 1024 * 1024;
+  const size_t footprint = GetFootprint(width, height);
+  std::cout << "estimated memory use is "
+            << (footprint + megabyte - 1) / megabyte << " MB of a budget of "
+            << budget / megabyte << " MB" << std::endl;
+  if (footprint > budget)
+    std::cerr << "warning: the memory budget is too small for a "
+              << width << "x" << height << " image" << std::endl;
+
   // Allocate some space for the work unit arrays
   traceUnits.reserve(numberOfTraceUnits);
   plotUnits.reserve(numberOfPlotUnits);
 
+  // All trace units learn into the same guiding field
+  if (settings.pathGuiding)
+  {
+    guidingField = std::unique_ptr<GuidingField>(new GuidingField());
+  }
+
+  // And they share the radiance cache
+  if (settings.radianceCache)
+  {
+    radianceCache = std::unique_ptr<RadianceCache>(new RadianceCache());
+  }
+
   // Build all the trace units, with a different random seed for all units
   unsigned long randomSeed = std::random_device()();
+  Settings traceSettings = settings;
+  traceSettings.packedPhotons = packPhotons;
   for (size_t i = 0; i < numberOfTraceUnits; i++)
   {
-    traceUnits.emplace_back(scene, randomSeed, width, height);
+    traceUnits.emplace_back(scene, randomSeed, width, height,
+                            maximumBatchSize, traceSettings,
+                            guidingField.get(), radianceCache.get());
     // Pick a different random seed for the next trace unit
     randomSeed = traceUnits[i].monteCarloUnit.randomEngine();
   }
 
-  // Then build the plot units
+  // Then build the plot units, which may share a single film
+  if (settings.sharedFilm)
+  {
+    sharedFilm = std::unique_ptr<SharedFilm>(new SharedFilm(width, height));
+  }
+  if (settings.filter != Settings::Bilinear)
+  {
+    reconstructionFilter = std::unique_ptr<ReconstructionFilter>(
+      new ReconstructionFilter(settings.filter, settings.filterRadius));
+  }
   for (size_t i = 0; i < numberOfPlotUnits; i++)
   {
-    plotUnits.emplace_back(width, height);
+    plotUnits.emplace_back(width, height, sharedFilm.get(),
+                           reconstructionFilter.get(),
+                           settings.spectralBands);
   }
 
   // There must be one gather unit
-  gatherUnit = std::unique_ptr<GatherUnit>(new GatherUnit(width, height));
+  gatherUnit = std::unique_ptr<GatherUnit>(
+    new GatherUnit(width, height, settings.spectralBands, compensateGather));
 
   // And finally the tonemap unit
-  tonemapUnit = std::unique_ptr<TonemapUnit>(new TonemapUnit(width, height));
-
-  // Everything is available at this point
-  for (int i = 0; i < (int)numberOfTraceUnits; i++) availableTraceUnits.push(i);
-  for (int i = 0; i < (int)numberOfPlotUnits; i++) availablePlotUnits.push(i);
+  tonemapUnit = std::unique_ptr<TonemapUnit>(
+    new TonemapUnit(width, height, settings));
+
+  // Nothing is known about the image yet, so paths start out uniformly
+  // distributed over the screen
+  screenDistribution = std::make_shared<ScreenDistribution>(width, height);
+
+  // And nothing has been learned about the light in the scene either
+  guidingDistribution = std::make_shared<GuidingDistribution>();
+
+  // No unit has been used by any worker yet
+  traceUnitHomes = std::vector<std::atomic<int>>(numberOfTraceUnits);
+  for (auto& home : traceUnitHomes) home = -1;
+  plotUnitHomes.resize(numberOfPlotUnits, -1);
+
+  // Every worker steals from different workers
+  for (size_t i = 0; i < workerQueues.size(); i++)
+    workerQueues[i].randomEngine.seed(static_cast<unsigned int>(i + 1));
+
+  // Nobody is waiting for work yet
+  workGeneration = 0;
+  waitingWorkers = 0;
+  for (auto& queue : workerQueues) queue.sleepGeneration = 0;
+
+  // Everything is available at this point, and the trace units are
+  // dealt out over the workers
+  numberOfReadyTraceUnits = 0;
+  numberOfDoneTraceUnits = 0;
+  for (int i = 0; i < (int)numberOfTraceUnits; i++)
+  {
+    Task task; task.type = Task::Trace;
+    task.unit = i;
+    PushTraceTask(i % workerQueues.size(), task);
+  }
+  for (int i = 0; i < (int)numberOfPlotUnits; i++) availablePlotUnits.push_back(i);
+  numberOfAvailablePlotUnits = numberOfPlotUnits;
   gatherUnitAvailable = true;
+  startedGatherParts = numberOfGatherParts + 1;
+  completedGatherParts = numberOfGatherParts + 1;
   tonemapUnitAvailable = true;
+  filmChanged = false;
 
   // The image has not changed (there is none)
   imageChanged = false;
 
   // Tonemap as soon as possible
   lastTonemapTime = steady_clock::now();
-  completedTraces = 0;
+  completedPaths = 0;
+  tracesSinceGather = 0;
+
+  // Nothing has been rendered yet
+  startTime = steady_clock::now();
+  startedPaths = 0;
+  finishing = false;
+  done = false;
 }
 
-Task TaskScheduler::GetNewTask(const Task completedTask)
+size_t TaskScheduler::GetFootprint(const int width, const int height) const
 {
-  // Acuire a lock during this function;
+  const size_t pixels = static_cast<size_t>(width) * height;
+  const size_t bands = static_cast<size_t>(settings.spectralBands);
+  const size_t batch = static_cast<size_t>(maximumBatchSize);
+  const size_t bufferedPhotons = TraceUnit::GetNumberOfBufferedPhotons();
+
+  // A trace unit keeps the photons of a batch, unless it plots them
+  // while tracing
+  size_t traceUnitSize = batch * sizeof(MappedPhoton);
+  if (settings.fusedPlotting)
+    traceUnitSize = bufferedPhotons * sizeof(MappedPhoton);
+  else if (packPhotons)
+    traceUnitSize = bufferedPhotons * sizeof(MappedPhoton)
+                  + batch * sizeof(PackedPhoton);
+
+  // A plot unit has a canvas of its own, unless the film is shared, and
+  // it may sort the photons of a trace unit
+  size_t plotUnitSize = 0;
+  if (bands > 0)
+    plotUnitSize = pixels * bands * sizeof(float);
+  else if (!settings.sharedFilm)
+    plotUnitSize = pixels * sizeof(Vector3);
+  if (bands == 0 && (settings.sharedFilm
+                     || pixels * sizeof(Vector3) > GetCacheSize(3) / 2))
+  {
+    const size_t photons = settings.fusedPlotting ? bufferedPhotons : batch;
+    plotUnitSize += photons * (sizeof(MappedPhoton) + sizeof(int));
+  }
+
+  // There is only one of all other units
+  const size_t compensation = compensateGather ? 2 : 1;
+  size_t fixedSize = bands > 0
+                   ? pixels * bands * sizeof(float) * compensation
+                   : pixels * sizeof(Vector3) * compensation;
+  fixedSize += pixels * 3;
+  if (bands > 0) fixedSize += pixels * sizeof(Vector3);
+  if (settings.sharedFilm && bands == 0)
+    fixedSize += pixels * sizeof(Vector3);
+  if (settings.pathGuiding)
+    fixedSize += GuidingField::numberOfCells * GuidingField::numberOfBins
+               * sizeof(float) * 2;
+  if (settings.radianceCache)
+    fixedSize += RadianceCache::numberOfCells * RadianceCache::numberOfBands
+               * (sizeof(float) + sizeof(int));
+
+  return numberOfTraceUnits * traceUnitSize
+       + numberOfPlotUnits * plotUnitSize + fixedSize;
+}
+
+Task TaskScheduler::GetNewTask(const Task completedTask, const int worker)
+{
+  // A trace unit that is done only goes back into the queue of the
+  // worker, that needs no lock
+  if (completedTask.type == Task::Trace)
+    CompleteTraceTask(completedTask, worker);
+
+  // Usually the next task is a trace task from the queue of the worker
+  // (or of another worker), unless something else is due
+  const bool completedOther = completedTask.type != Task::Trace
+                           && completedTask.type != Task::Sleep;
+  Task task;
+  if (!completedOther && !MustSchedule()
+      && TakeTraceTask(worker, task, false)) return task;
+
+  // Acuire a lock for the rest of this function;
   // no threads may simultaneously access the scheduling functionality
   std::unique_lock<std::mutex> lock(mutex);
+  requestingWorker = worker;
 
   // Make units that were used by the completed task available again
   CompleteTask(completedTask);
 
+  // If the worker must sleep, it waits until anything changes after
+  // this point, so it cannot miss the change that it waits for
+  const unsigned long long generation = workGeneration;
+  task = ChooseTask();
+  numberOfAvailablePlotUnits = availablePlotUnits.size();
+  if (task.type == Task::Sleep)
+    workerQueues[worker].sleepGeneration = generation;
+
+  // Completing a task frees units, a gather can be helped with by all
+  // workers, and once rendering is done, nobody needs to wait any more
+  if (completedOther || task.type == Task::Gather || done) WakeWorkers();
+
+  return task;
+}
+
+void TaskScheduler::WaitForWork(const int worker)
+{
+  const unsigned long long generation =
+    workerQueues[worker].sleepGeneration;
+
+  // Work often comes in soon, and then checking for it is cheaper than
+  // waiting to be woken
+  const auto spinEnd = steady_clock::now()
+                     + std::chrono::microseconds(settings.spinTime);
+  while (steady_clock::now() < spinEnd)
+  {
+    if (workGeneration != generation) return;
+    std::this_thread::yield();
+  }
+
+  // Time passing makes work available too: the next tonemap, and the
+  // end of the time budget (unless that moment has passed already,
+  // then the work waits for something else)
+  const auto now = steady_clock::now();
+  auto wakeTime = lastTonemapTime.load() + tonemappingInterval;
+  if (settings.timeLimit > 0.0)
+  {
+    const auto endTime = startTime
+      + duration_cast<steady_clock::duration>(
+          std::chrono::duration<double>(settings.timeLimit));
+    if (endTime > now && (endTime < wakeTime || wakeTime <= now))
+      wakeTime = endTime;
+  }
+
+  std::unique_lock<std::mutex> lock(waitMutex);
+  waitingWorkers++;
+  const auto changed = [&]() { return workGeneration != generation; };
+  if (wakeTime > now)
+    workAvailable.wait_until(lock, wakeTime, changed);
+  else
+    workAvailable.wait(lock, changed);
+  waitingWorkers--;
+}
+
+void TaskScheduler::WakeWorkers()
+{
+  workGeneration++;
+
+  // A worker that starts waiting counts itself before it checks the
+  // generation, so if nobody was counted, nobody can miss the change
+  if (waitingWorkers > 0)
+  {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    workAvailable.notify_all();
+  }
+}
+
+void TaskScheduler::WakeWorker()
+{
+  workGeneration++;
+
+  if (waitingWorkers > 0)
+  {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    workAvailable.notify_one();
+  }
+}
+
+bool TaskScheduler::MustSchedule() const
+{
+  // Parts of a gather are waiting to be handed out
+  if (CanGatherPart()) return true;
+
+  // A stopping criterion has been met
+  if (finishing || IsSampleBudgetSpent() || IsTimeBudgetSpent()) return true;
+
+  // The image should be tonemapped
+  if (steady_clock::now() - lastTonemapTime.load() > tonemappingInterval)
+    return true;
+
+  // Enough trace units are done that they should be plotted
+  if (numberOfDoneTraceUnits > numberOfTraceUnits / 2
+      && numberOfAvailablePlotUnits > 0) return true;
+
+  // Or enough was traced (and plotted) that it should be gathered
+  return (settings.fusedPlotting || settings.sharedFilm)
+      && tracesSinceGather >= numberOfTraceUnits && gatherUnitAvailable;
+}
+
+Task TaskScheduler::ChooseTask()
+{
+  // Plot units wait for the gather they are part of, so hand out the
+  // rest of it first
+  if (CanGatherPart()) return CreateGatherPartTask();
+
+  // Once a stopping criterion has been met, only the remaining work
+  // is finished
+  CheckBudget();
+  if (finishing) return GetFinishingTask();
+
   // If the last tonemapping time was more than x seconds ago,
   // an update should be done
   auto now = steady_clock::now();
-  if (now - lastTonemapTime > tonemappingInterval)
+  if (now - lastTonemapTime.load() > tonemappingInterval)
   {
     // If the image has changed since it was last tonemapped,
     // tonemap it now
@@ -100,25 +429,32 @@ Task TaskScheduler::GetNewTask(const Task completedTask)
     {
       // Otherwise, plots must first be gathered, tonemapping will
       // happen once that is done
-      if (gatherUnitAvailable && !donePlotUnits.empty())
-        return CreateGatherTask();
+      if (CanGather()) return CreateGatherTask();
     }
   }
 
   // If a substantial number of trace units is done, plot them first
   // so they can be recycled soon
-  if (doneTraceUnits.size() > numberOfTraceUnits / 2
+  if (numberOfDoneTraceUnits > numberOfTraceUnits / 2
       && !availablePlotUnits.empty()) return CreatePlotTask();
 
+  // When tracing plots its own photons, or plot units share a film,
+  // nothing runs out, so gather once every trace unit completed a batch
+  // on average
+  if ((settings.fusedPlotting || settings.sharedFilm)
+      && tracesSinceGather >= numberOfTraceUnits
+      && CanGather()) return CreateGatherTask();
+
   // Then, if there are enough trace units available, go trace some rays!
-  if (!availableTraceUnits.empty())
+  Task task;
+  if (TakeTraceTask(requestingWorker, task, true))
   {
-    return CreateTraceTask();
+    return task;
   }
 
   // Otherwise, some trace units need to be plotted to make them
   // available again
-  if (!availablePlotUnits.empty() && !doneTraceUnits.empty())
+  if (!availablePlotUnits.empty() && numberOfDoneTraceUnits > 0)
   {
     return CreatePlotTask();
   }
@@ -126,7 +462,7 @@ Task TaskScheduler::GetNewTask(const Task completedTask)
   // If no plot units are available (or all trace units are busy,
   // which should be impossible), gather some plots to make the plot
   // units available again
-  if (gatherUnitAvailable && !donePlotUnits.empty())
+  if (CanGather())
   {
     return CreateGatherTask();
   }
@@ -136,38 +472,250 @@ Task TaskScheduler::GetNewTask(const Task completedTask)
   return CreateSleepTask();
 }
 
+std::shared_ptr<const ScreenDistribution>
+TaskScheduler::GetScreenDistribution() const
+{
+  return std::atomic_load(&screenDistribution);
+}
+
+void TaskScheduler::SetScreenDistribution(
+  std::shared_ptr<const ScreenDistribution> distribution)
+{
+  std::atomic_store(&screenDistribution, distribution);
+}
+
+std::shared_ptr<const GuidingDistribution>
+TaskScheduler::GetGuidingDistribution() const
+{
+  return std::atomic_load(&guidingDistribution);
+}
+
+void TaskScheduler::SetGuidingDistribution(
+  std::shared_ptr<const GuidingDistribution> distribution)
+{
+  std::atomic_store(&guidingDistribution, distribution);
+}
+
+bool TaskScheduler::IsDone() const
+{
+  return done;
+}
+
+void TaskScheduler::CheckBudget()
+{
+  if (finishing) return;
+
+  if (IsSampleBudgetSpent())
+  {
+    std::cout << "sample budget reached, finishing" << std::endl;
+    finishing = true;
+  }
+
+  if (IsTimeBudgetSpent())
+  {
+    std::cout << "time budget reached, finishing" << std::endl;
+    finishing = true;
+  }
+}
+
+bool TaskScheduler::IsSampleBudgetSpent() const
+{
+  return settings.maximumSamples > 0
+      && startedPaths >= settings.maximumSamples;
+}
+
+bool TaskScheduler::IsTimeBudgetSpent() const
+{
+  if (settings.timeLimit <= 0.0) return false;
+
+  const double elapsed = duration_cast<std::chrono::duration<double>>(
+    steady_clock::now() - startTime).count();
+  return elapsed >= settings.timeLimit;
+}
+
+Task TaskScheduler::GetFinishingTask()
+{
+  // Plot everything that has been traced
+  if (numberOfDoneTraceUnits > 0 && !availablePlotUnits.empty())
+    return CreatePlotTask();
+
+  // And gather everything that has been plotted
+  if (CanGather()) return CreateGatherTask();
+
+  // Other tasks might still produce data, wait for them
+  const bool idle = numberOfReadyTraceUnits == numberOfTraceUnits
+                 && availablePlotUnits.size() == numberOfPlotUnits
+                 && gatherUnitAvailable && tonemapUnitAvailable;
+  if (!idle) return CreateSleepTask();
+
+  // Then tonemap the final image, and rendering is done
+  if (imageChanged) return CreateTonemapTask();
+
+  done = true;
+  return CreateSleepTask();
+}
+
 Task TaskScheduler::CreateSleepTask()
 {
   Task task; task.type = Task::Sleep;
   return task;
 }
 
-Task TaskScheduler::CreateTraceTask()
+bool TaskScheduler::CanGather()
 {
-  // Pick the first available trace unit, and use it for the task
-  Task task; task.type = Task::Trace;
-  task.unit = availableTraceUnits.front();
-  availableTraceUnits.pop();
+  if (!gatherUnitAvailable) return false;
 
-  return task;
+  ReleasePlotUnits();
+  return !donePlotUnits.empty() || filmChanged;
+}
+
+void TaskScheduler::ReleasePlotUnits()
+{
+  if (!settings.fusedPlotting) return;
+
+  for (auto& queue : workerQueues)
+  {
+    std::lock_guard<std::mutex> queueLock(queue.mutex);
+    for (auto& task : queue.tasks)
+    {
+      for (const int plotUnit : task.otherUnits) CompletePlot(plotUnit);
+      task.otherUnits.clear();
+    }
+  }
+}
+
+bool TaskScheduler::CanGatherPart() const
+{
+  return startedGatherParts < numberOfGatherParts
+      || (startedGatherParts == numberOfGatherParts
+          && completedGatherParts == numberOfGatherParts);
+}
+
+bool TaskScheduler::TakeTraceTask(const int worker, Task& task,
+                                  const bool locked)
+{
+  if (!PopTraceTask(worker, task)) return false;
+
+  // Without the lock, the scheduler may have started finishing in the
+  // meantime, and a fused trace task without a plot unit cannot get one
+  if (!locked && (finishing
+                  || (settings.fusedPlotting && task.otherUnits.empty())))
+  {
+    PushTraceTask(worker, task);
+    return false;
+  }
+
+  // Have it plot into a plot unit directly, preferably into one that
+  // is empty
+  if (settings.fusedPlotting && task.otherUnits.empty())
+  {
+    if (availablePlotUnits.empty() && donePlotUnits.empty())
+    {
+      PushTraceTask(worker, task);
+      return false;
+    }
+
+    std::deque<int>& plotUnits = availablePlotUnits.empty()
+                               ? donePlotUnits : availablePlotUnits;
+    task.otherUnits.push_back(TakeUnit(plotUnits, plotUnitHomes));
+  }
+
+  // If the trace unit was never used, this worker becomes its home
+  int home = -1;
+  traceUnitHomes[task.unit].compare_exchange_strong(home, worker);
+
+  task.numberOfPaths = batchSize;
+  task.startTime = steady_clock::now();
+
+  // Keep track of the sample budget
+  startedPaths += task.numberOfPaths;
+
+  return true;
+}
+
+bool TaskScheduler::PopTraceTask(const int worker, Task& task)
+{
+  // The newest task of this worker comes first
+  WorkerQueue& own = workerQueues[worker];
+  {
+    std::lock_guard<std::mutex> queueLock(own.mutex);
+    if (!own.tasks.empty())
+    {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      numberOfReadyTraceUnits--;
+      return true;
+    }
+  }
+
+  // Then steal the oldest task of another worker. The random first
+  // victim spreads thieves over the workers.
+  if (numberOfReadyTraceUnits == 0) return false;
+  const size_t n = workerQueues.size();
+  const size_t first = own.randomEngine() % n;
+  for (size_t i = 0; i < n; i++)
+  {
+    WorkerQueue& victim = workerQueues[(first + i) % n];
+    if (&victim == &own) continue;
+
+    std::lock_guard<std::mutex> queueLock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      numberOfReadyTraceUnits--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void TaskScheduler::PushTraceTask(const int worker, const Task& task)
+{
+  WorkerQueue& queue = workerQueues[worker];
+  std::lock_guard<std::mutex> queueLock(queue.mutex);
+  queue.tasks.push_back(task);
+  numberOfReadyTraceUnits++;
+}
+
+int TaskScheduler::TakeUnit(std::deque<int>& units, std::vector<int>& homes)
+{
+  auto unit = std::find_if(units.begin(), units.end(), [&](const int i)
+  {
+    return homes[i] == requestingWorker;
+  });
+  if (unit == units.end()) unit = units.begin();
+
+  const int index = *unit;
+  units.erase(unit);
+  if (homes[index] < 0) homes[index] = requestingWorker;
+  return index;
 }
 
 Task TaskScheduler::CreatePlotTask()
 {
   // Pick the first available plot unit, and use it for the task
   Task task; task.type = Task::Plot;
-  task.unit = availablePlotUnits.front();
-  availablePlotUnits.pop();
+  task.unit = TakeUnit(availablePlotUnits, plotUnitHomes);
 
   // Take around half of the trace units which are done for this task
-  const size_t done = doneTraceUnits.size();
+  const size_t done = numberOfDoneTraceUnits;
   const size_t n = std::min(done, std::max<size_t>(1, done / 2));
 
-  // Have it plot trace units which are done
-  for (size_t i = 0; i < n; i++)
+  // Have it plot trace units which are done, those that the requesting
+  // worker traced first, because they may still be in its cache
+  const size_t workers = workerQueues.size();
+  for (size_t i = 0; i < workers && task.otherUnits.size() < n; i++)
   {
-    task.otherUnits.push_back(doneTraceUnits.front());
-    doneTraceUnits.pop();
+    WorkerQueue& queue = workerQueues[(requestingWorker + i) % workers];
+    std::lock_guard<std::mutex> queueLock(queue.mutex);
+    while (!queue.doneTraceUnits.empty() && task.otherUnits.size() < n)
+    {
+      task.otherUnits.push_back(queue.doneTraceUnits.back());
+      queue.doneTraceUnits.pop_back();
+      numberOfDoneTraceUnits--;
+    }
   }
 
   return task;
@@ -175,18 +723,30 @@ Task TaskScheduler::CreatePlotTask()
 
 Task TaskScheduler::CreateGatherTask()
 {
-  Task task; task.type = Task::Gather;
-
   // The gather unit will be busy gathering
   gatherUnitAvailable = false;
+  tracesSinceGather = 0;
+  filmChanged = false;
 
   // Have it gather all plot units which are done
+  gatheringPlotUnits.clear();
   while (!donePlotUnits.empty())
   {
-    task.otherUnits.push_back(donePlotUnits.front());
-    donePlotUnits.pop();
+    gatheringPlotUnits.push_back(donePlotUnits.front());
+    donePlotUnits.pop_front();
   }
 
+  // Other threads can help by taking the other parts
+  startedGatherParts = 0;
+  completedGatherParts = 0;
+  return CreateGatherPartTask();
+}
+
+Task TaskScheduler::CreateGatherPartTask()
+{
+  Task task; task.type = Task::Gather;
+  task.unit = startedGatherParts++;
+  task.otherUnits = gatheringPlotUnits;
   return task;
 }
 
@@ -207,26 +767,80 @@ void TaskScheduler::CompleteTask(const Task completedTask)
   // Delegate the task to the correct method
   switch (completedTask.type)
   {
-    case Task::Trace:   CompleteTraceTask(completedTask);   break;
+    case Task::Trace:                                       break;
     case Task::Plot:    CompletePlotTask(completedTask);    break;
     case Task::Gather:  CompleteGatherTask(completedTask);  break;
     case Task::Tonemap: CompleteTonemapTask();              break;
     case Task::Sleep:                                       break;
   }
 
-  // The 'Sleep' task is ignored; it consumes no resources
+  // The 'Trace' task was completed without the lock already, and the
+  // 'Sleep' task is ignored; it consumes no resources
   if (completedTask.type == Task::Sleep) std::cout << ".";
 }
 
-void TaskScheduler::CompleteTraceTask(const Task completedTask)
+void TaskScheduler::CompleteTraceTask(const Task completedTask,
+                                      const int worker)
 {
   std::cout << "done tracing with unit " << completedTask.unit << std::endl;
 
+  completedPaths += completedTask.numberOfPaths;
+  tracesSinceGather++;
+  AdjustBatchSize(completedTask);
+
+  // When the trace unit plotted its own photons, it continues tracing
+  // into the same plot unit, until the plot unit is gathered
+  if (!completedTask.otherUnits.empty())
+  {
+    if (sharedFilm) filmChanged = true;
+
+    Task task; task.type = Task::Trace;
+    task.unit = completedTask.unit;
+    task.otherUnits = completedTask.otherUnits;
+    PushTraceTask(worker, task);
+    return;
+  }
+
   // The trace unit used for the task, now need plotting before it is
   // available again
-  doneTraceUnits.push(completedTask.unit);
+  WorkerQueue& queue = workerQueues[worker];
+  {
+    std::lock_guard<std::mutex> queueLock(queue.mutex);
+    queue.doneTraceUnits.push_back(completedTask.unit);
+    numberOfDoneTraceUnits++;
+  }
+
+  // A waiting worker may be able to plot it
+  WakeWorker();
+}
 
-  completedTraces++;
+void TaskScheduler::AdjustBatchSize(const Task& completedTraceTask)
+{
+  if (settings.batchSize > 0) return;
+
+  // Average the time per path over the last few tasks, to smooth out
+  // tasks that happened to trace expensive paths
+  const double seconds = duration_cast<std::chrono::duration<double>>(
+    steady_clock::now() - completedTraceTask.startTime).count();
+  const double perPath = seconds / completedTraceTask.numberOfPaths;
+
+  // Other workers may complete a task at the same time, but a
+  // compare-and-swap loop rarely has to retry
+  double average = secondsPerPath.load();
+  double newAverage;
+  do
+  {
+    newAverage = average > 0.0 ? average * 0.75 + perPath * 0.25 : perPath;
+  }
+  while (!secondsPerPath.compare_exchange_weak(average, newAverage));
+
+  const double size = settings.taskTime / newAverage;
+  if (size >= maximumBatchSize)
+    batchSize = maximumBatchSize;
+  else if (size <= minimumBatchSize)
+    batchSize = minimumBatchSize;
+  else
+    batchSize = static_cast<int>(size);
 }
 
 void TaskScheduler::CompletePlotTask(Task completedTask)
@@ -234,30 +848,51 @@ void TaskScheduler::CompletePlotTask(Task completedTask)
   std::cout << "done plotting with unit " << completedTask.unit << std::endl;
   std::cout << "the following trace units are available again: ";
 
-  // All the trace units that were plotted, can be used again now
+  // All the trace units that were plotted, can be used again now, by
+  // the worker that used them before
   while (!completedTask.otherUnits.empty())
   {
-    availableTraceUnits.push(completedTask.otherUnits.back());
+    Task task; task.type = Task::Trace;
+    task.unit = completedTask.otherUnits.back();
     completedTask.otherUnits.pop_back();
-    std::cout << " " << availableTraceUnits.back() << " ";
+    PushTraceTask(traceUnitHomes[task.unit], task);
+    std::cout << " " << task.unit << " ";
   }
 
   std::cout << std::endl;
 
-  // And the plot unit that was used, needs to be gathered before it can
-  // be used again
-  donePlotUnits.push(completedTask.unit);
+  CompletePlot(completedTask.unit);
+}
+
+void TaskScheduler::CompletePlot(const int plotUnit)
+{
+  // A plot unit that plots into the shared film has nothing left to
+  // gather, but the film has
+  if (sharedFilm)
+  {
+    availablePlotUnits.push_back(plotUnit);
+    filmChanged = true;
+    return;
+  }
+
+  // Otherwise the plot unit that was used, needs to be gathered before
+  // it can be used again
+  donePlotUnits.push_back(plotUnit);
 }
 
 void TaskScheduler::CompleteGatherTask(Task completedTask)
 {
+  // Only the final part completes the gather
+  completedGatherParts++;
+  if (completedTask.unit < numberOfGatherParts) return;
+
   std::cout << "done gathering" << std::endl;
   std::cout << "the following plot units are available again: ";
 
   // All the plot units that were gathered, can be used again now
   while (!completedTask.otherUnits.empty())
   {
-    availablePlotUnits.push(completedTask.otherUnits.back());
+    availablePlotUnits.push_back(completedTask.otherUnits.back());
     completedTask.otherUnits.pop_back();
     std::cout << " " << availablePlotUnits.back() << " ";
   }
@@ -269,6 +904,19 @@ void TaskScheduler::CompleteGatherTask(Task completedTask)
 
   // The image must have changed because of gathering
   imageChanged = true;
+
+  // See whether the image is good enough already
+  if (settings.noiseThreshold > 0.0f && !finishing)
+  {
+    const float error = gatherUnit->GetRelativeError();
+    std::cout << "relative error: " << error << std::endl;
+
+    if (error <= settings.noiseThreshold)
+    {
+      std::cout << "noise threshold reached, finishing" << std::endl;
+      finishing = true;
+    }
+  }
 }
 
 #include <algorithm>
@@ -289,24 +937,29 @@ void TaskScheduler::CompleteTonemapTask()
 
   // Measure how many rays per second the renderer can handle.
   const auto now = steady_clock::now();
-  const auto renderTime = now - lastTonemapTime;
+  const auto renderTime = now - lastTonemapTime.load();
   const auto ms = duration_cast<std::chrono::milliseconds>(renderTime);
-  const auto batchesPerSecond = completedTraces * 1000.0f / ms.count();
+  const auto pathsPerSecond = completedPaths.exchange(0) * 1000.0
+                            / ms.count();
   lastTonemapTime = now;
-  completedTraces = 0;
 
   // Store the latest 512 measurements (should be about 4.25 hours).
-  performance.push_back(batchesPerSecond);
+  performance.push_back(pathsPerSecond);
   if (performance.size() > 512) performance.pop_front();
-  float n = static_cast<float>(performance.size());
-
-  float mean = std::accumulate(performance.begin(), performance.end(), 0.0f) / n;
 
-  float sqrMean = std::accumulate(performance.begin(), performance.end(), 0.0f,
-                  [](float a, float perf) { return a + perf * perf; }) / n;
-
-  float variance = sqrMean - mean * mean;
+  // Welford's method keeps the variance accurate (and positive) where
+  // the difference of the mean square and the squared mean cancels
+  double mean = 0.0, sumOfSquares = 0.0;
+  int n = 0;
+  for (const double perf : performance)
+  {
+    n++;
+    const double delta = perf - mean;
+    mean += delta / n;
+    sumOfSquares += delta * (perf - mean);
+  }
+  const double variance = sumOfSquares / n;
 
   std::cout << "performance: " << mean << " +- " << std::sqrt(variance)
-            << " batches/sec" << std::endl;
+            << " paths/sec" << std::endl;
 }
@@ -16,12 +16,22 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <deque>
 #include <mutex>
-#include <queue>
+#include <random>
+#include <vector>
 #include "GatherUnit.h"
+#include "GuidingField.h"
 #include "PlotUnit.h"
+#include "ReconstructionFilter.h"
+#include "RadianceCache.h"
+#include "ScreenDistribution.h"
+#include "Settings.h"
+#include "SharedFilm.h"
 #include "Task.h"
 #include "TonemapUnit.h"
 #include "TraceUnit.h"
@@ -36,24 +46,80 @@ namespace Luculentus
   {
     private:
 
-      /// The indices of all TraceUnits which are available for tracing
-      /// rays.
-      std::queue<int> availableTraceUnits;
-      
-      /// The indices of all TraceUnits which have MappedPhotons that
-      /// must be plotted, before the TraceUnit can be used again.
-      std::queue<int> doneTraceUnits;
+      /// The work of a single worker. Other workers may steal from it,
+      /// so it has a lock of its own.
+      struct WorkerQueue
+      {
+        /// Protects the tasks and the trace units.
+        std::mutex mutex;
+
+        /// A trace task for every TraceUnit that is available for
+        /// tracing rays. The worker takes the newest task, so its
+        /// buffers are still in the cache, and thieves take the oldest.
+        std::deque<Task> tasks;
+
+        /// The indices of the TraceUnits that this worker traced, which
+        /// have MappedPhotons that must be plotted, before the
+        /// TraceUnit can be used again.
+        std::vector<int> doneTraceUnits;
+
+        /// Picks the workers to steal from (only used by the worker
+        /// itself).
+        std::minstd_rand randomEngine;
+
+        /// The work generation at the moment the worker was last given
+        /// a 'Sleep' task.
+        unsigned long long sleepGeneration;
+      };
+
+      /// The queue of every worker.
+      std::vector<WorkerQueue> workerQueues;
+
+      /// The number of trace tasks in all worker queues together.
+      std::atomic<size_t> numberOfReadyTraceUnits;
+
+      /// The number of TraceUnits in all worker queues together that
+      /// must be plotted.
+      std::atomic<size_t> numberOfDoneTraceUnits;
 
       /// The indices of all PlotUnits which are available for plotting
       /// MappedPhotons.
-      std::queue<int> availablePlotUnits;
+      std::deque<int> availablePlotUnits;
+
+      /// The number of PlotUnits available, as of the last time the
+      /// scheduler was locked, so that it can be read without the lock.
+      std::atomic<size_t> numberOfAvailablePlotUnits;
 
       /// The indices of all PlotUnits which have a screen that must be
-      /// accumulated, before the PlotUnit can be used again.
-      std::queue<int> donePlotUnits;
+      /// accumulated, before the PlotUnit can be used again. When
+      /// plotting is fused with tracing, trace tasks may keep plotting
+      /// into them until they are gathered.
+      std::deque<int> donePlotUnits;
+
+      /// The worker that first used every TraceUnit and PlotUnit, or -1
+      /// if it has not been used yet. The buffers of a unit are placed
+      /// close to that worker, so it is preferably used by it again.
+      std::vector<std::atomic<int>> traceUnitHomes;
+      std::vector<int> plotUnitHomes;
+
+      /// The worker that asked for the task that is being created.
+      int requestingWorker;
 
       /// Whether the GatherUnit is not used at the moment.
-      bool gatherUnitAvailable;
+      std::atomic<bool> gatherUnitAvailable;
+
+      /// The PlotUnits that the current gather accumulates.
+      std::vector<int> gatheringPlotUnits;
+
+      /// The number of parts of the current gather that have been
+      /// handed out, and that have been completed. When no gather is in
+      /// progress, both are past the final part.
+      std::atomic<int> startedGatherParts;
+      std::atomic<int> completedGatherParts;
+
+      /// Whether photons were plotted into the shared film since the
+      /// last gather.
+      std::atomic<bool> filmChanged;
 
       /// Whether the TonemapUnit is not used at the moment.
       bool tonemapUnitAvailable;
@@ -63,19 +129,86 @@ namespace Luculentus
       bool imageChanged;
 
       /// The last time the image was tonemapped (and displayed)
-      std::chrono::steady_clock::time_point lastTonemapTime;
+      std::atomic<std::chrono::steady_clock::time_point> lastTonemapTime;
 
-      /// The number of completed trace batches since the last tonemap.
+      /// The number of paths traced since the last tonemap.
       /// Used to measure performance.
-      unsigned int completedTraces;
+      std::atomic<unsigned long long> completedPaths;
+
+      /// The number of completed trace batches since the last gather.
+      /// When plotting is fused with tracing, it decides when to gather.
+      std::atomic<unsigned int> tracesSinceGather;
+
+      /// Previous measurements of paths/second, used to determine variance.
+      std::deque<double> performance;
 
-      /// Previous measurements of batches/second, used to determine variance.
-      std::deque<float> performance;
+      /// The settings that determine when rendering is done.
+      const Settings settings;
 
-      /// A mutex that ensures only one thread can
-      /// access the task scheduler at a given instant.
+      /// The time at which rendering started.
+      std::chrono::steady_clock::time_point startTime;
+
+      /// The number of paths for which a trace task has been created.
+      std::atomic<unsigned long long> startedPaths;
+
+      /// The number of paths per trace task.
+      std::atomic<int> batchSize;
+
+      /// The largest number of paths per trace task, for which the trace
+      /// units have room.
+      int maximumBatchSize;
+
+      /// The average time it took to trace a path recently (in seconds),
+      /// from which the batch size is adjusted. Zero if unknown.
+      std::atomic<double> secondsPerPath;
+
+      /// The smallest number of paths per trace task, when the batch
+      /// size is adjusted while rendering.
+      static const int minimumBatchSize = 4096;
+
+      /// Whether trace units pack their photons, because the settings
+      /// ask for it, or to fit in the memory budget.
+      bool packPhotons;
+
+      /// Whether the gather unit compensates its sums for lost low-order
+      /// bits, which it does unless the memory budget is tight.
+      bool compensateGather;
+
+      /// Whether a stopping criterion has been met. No new paths are
+      /// traced, but the remaining work is finished.
+      std::atomic<bool> finishing;
+
+      /// Whether all work is finished after a stopping criterion was
+      /// met, and the final image has been tonemapped.
+      std::atomic<bool> done;
+
+      /// The distribution used to pick screen positions for new paths.
+      /// It is replaced as a whole, so it must be accessed atomically.
+      std::shared_ptr<const ScreenDistribution> screenDistribution;
+
+      /// The distribution used to guide new paths. It is replaced as a
+      /// whole, so it must be accessed atomically.
+      std::shared_ptr<const GuidingDistribution> guidingDistribution;
+
+      /// A mutex that ensures only one thread can access the scheduling
+      /// functionality at a given instant. Workers that only need a
+      /// trace task take it from the worker queues without it.
       std::mutex mutex;
 
+      /// The number of times that something became available that a
+      /// waiting worker might use. Workers wait until it changes.
+      std::atomic<unsigned long long> workGeneration;
+
+      /// The number of workers that wait for the work generation to
+      /// change.
+      std::atomic<int> waitingWorkers;
+
+      /// Protects waiting for the work generation to change.
+      std::mutex waitMutex;
+
+      /// Signals waiting workers that the work generation changed.
+      std::condition_variable workAvailable;
+
       /// The interval at which tonemapping happens, in seconds
       const static std::chrono::steady_clock::duration tonemappingInterval;
 
@@ -89,6 +222,11 @@ namespace Luculentus
       /// (not all of them have to be active simultaneously).
       size_t numberOfPlotUnits;
 
+      /// The number of horizontal strips the canvas is divided into when
+      /// gathering, so that several threads can gather at once. After
+      /// all strips, a final part (with this index) finishes the gather.
+      int numberOfGatherParts;
+
       /// An array of all TraceUnits in the tracer.
       std::vector<TraceUnit> traceUnits;
 
@@ -98,48 +236,180 @@ namespace Luculentus
       /// The single GatherUnit.
       std::unique_ptr<GatherUnit>  gatherUnit;
 
+      /// The film that all plot units plot into, or null if every plot
+      /// unit has a canvas of its own.
+      std::unique_ptr<SharedFilm> sharedFilm;
+
+      /// The filter that all plot units plot with, or null if they plot
+      /// bilinearly.
+      std::unique_ptr<ReconstructionFilter> reconstructionFilter;
+
       /// The single TonemapUnit.
       std::unique_ptr<TonemapUnit> tonemapUnit;
 
+      /// The field that all trace units learn into, or null if path
+      /// guiding is disabled.
+      std::unique_ptr<GuidingField> guidingField;
+
+      /// The cache that all trace units share, or null if the radiance
+      /// cache is disabled.
+      std::unique_ptr<RadianceCache> radianceCache;
+
       /// Creates a new task scheduler, that will render the specified
       /// scene to a canvas of specified size.
       TaskScheduler(const int numberOfThreads, const int width,
-                    const int height, const Scene& scene);
+                    const int height, const Scene& scene,
+                    const Settings& renderSettings);
 
       /// Notifies the task scheduler that a task is complete.
-      /// The task scheduler will find some more work to do,
-      /// and return it to the caller.
+      /// The task scheduler will find some more work to do for the
+      /// worker with the specified index, and return it to the caller.
+      /// This method is thread-safe. Workers take trace tasks from
+      /// queues of their own, and steal from other workers when their
+      /// queue is empty, so the scheduler is only locked for the rest.
+      Task GetNewTask(const Task completedTask, const int worker);
+
+      /// Blocks the worker that was given a 'Sleep' task, until a unit
+      /// that it could use may have become available, or until it is
+      /// time to tonemap or to stop. It keeps checking during the spin
+      /// time of the settings first. This method is thread-safe.
+      void WaitForWork(const int worker);
+
+      /// Wakes all waiting workers, because work became available or
+      /// because they should stop. This method is thread-safe.
+      void WakeWorkers();
+
+      /// Returns whether a stopping criterion was met and all work that
+      /// was started has been finished, including the final tonemap.
+      /// This method is thread-safe.
+      bool IsDone() const;
+
+      /// Returns the distribution that new paths should use.
       /// This method is thread-safe.
-      Task GetNewTask(const Task completedTask);
+      std::shared_ptr<const ScreenDistribution> GetScreenDistribution() const;
+
+      /// Replaces the distribution that new paths should use, paths
+      /// that are being traced still use the old distribution.
+      /// This method is thread-safe.
+      void SetScreenDistribution(
+        std::shared_ptr<const ScreenDistribution> distribution);
+
+      /// Returns the distribution that new paths should be guided with.
+      /// This method is thread-safe.
+      std::shared_ptr<const GuidingDistribution> GetGuidingDistribution() const;
+
+      /// Replaces the distribution that new paths should be guided with.
+      /// This method is thread-safe.
+      void SetGuidingDistribution(
+        std::shared_ptr<const GuidingDistribution> distribution);
 
     private:
 
+      /// Returns the estimated memory (in bytes) that the buffers of all
+      /// units use, with the current number of units, batch size and
+      /// precision, for an image of the specified size.
+      size_t GetFootprint(const int width, const int height) const;
+
+      /// Returns whether anything other than a trace task is due, which
+      /// only the locked scheduler can hand out. This method is
+      /// thread-safe.
+      bool MustSchedule() const;
+
+      /// Picks the task that is most urgent. The scheduler must be
+      /// locked.
+      Task ChooseTask();
+
+      /// Returns a task that brings rendering to a halt: it finishes
+      /// the outstanding traces, plots and gathers, and tonemaps the
+      /// final image.
+      Task GetFinishingTask();
+
+      /// Checks the time and sample budget, and starts finishing if
+      /// either of them has run out.
+      void CheckBudget();
+
+      /// Returns whether the sample budget or the time budget has run
+      /// out. These methods are thread-safe.
+      bool IsSampleBudgetSpent() const;
+      bool IsTimeBudgetSpent() const;
+
       /// Creates a new 'Sleep' task.
       Task CreateSleepTask();
 
-      /// Creates a new 'Trace' task.
-      Task CreateTraceTask();
+      /// Takes a 'Trace' task from the queue of the worker, or steals one
+      /// from another worker, and starts it. A task that plots its own
+      /// photons needs a PlotUnit, which is only handed out when the
+      /// scheduler is locked. Returns whether there was a task.
+      bool TakeTraceTask(const int worker, Task& task, const bool locked);
+
+      /// Takes the newest task from the queue of the worker, or else the
+      /// oldest task of another worker, starting at a random one.
+      /// Returns whether there was a task. This method is thread-safe.
+      bool PopTraceTask(const int worker, Task& task);
+
+      /// Adds a 'Trace' task to the queue of the worker. Waiting
+      /// workers are not woken: either the worker takes the task itself
+      /// next, or the scheduler wakes them when it is done.
+      /// This method is thread-safe.
+      void PushTraceTask(const int worker, const Task& task);
+
+      /// Wakes a single waiting worker, because a single unit became
+      /// available. This method is thread-safe.
+      void WakeWorker();
+
+      /// Takes a unit from the queue, preferably one that was used by
+      /// the requesting worker before. If the unit was never used, the
+      /// requesting worker becomes its home.
+      int TakeUnit(std::deque<int>& units, std::vector<int>& homes);
+
+      /// Returns whether a gather task can be created, and has anything
+      /// to gather. The PlotUnits of queued trace tasks are released
+      /// then, so they can be gathered too.
+      bool CanGather();
+
+      /// Takes the PlotUnits from the trace tasks in the worker queues,
+      /// to be gathered (or reused).
+      void ReleasePlotUnits();
+
+      /// Returns whether a part of the current gather can be handed out:
+      /// a strip, or the final part once all strips are done.
+      bool CanGatherPart() const;
+
+      /// Adjusts the batch size, so that trace tasks take about as long
+      /// as the settings prescribe.
+      void AdjustBatchSize(const Task& completedTraceTask);
 
       /// Creates a new 'Plot' task that plots some TraceUnits which are
       /// done.
       Task CreatePlotTask();
 
-      /// Creates a new 'Gather' task that gathers some PlotUnits which
-      /// are done.
+      /// Starts gathering the PlotUnits which are done, and creates a
+      /// 'Gather' task for its first part.
       Task CreateGatherTask();
 
+      /// Creates a 'Gather' task for the next part of the current
+      /// gather.
+      Task CreateGatherPartTask();
+
       /// Creates a new 'Tonemap' task.
       Task CreateTonemapTask();
       
       /// Makes resources used by the task available again.
       void CompleteTask(const Task completeTask);
 
-      /// Makes resourced used by a 'Trace' task available again.
-      void CompleteTraceTask(const Task completedTask);
+      /// Makes resourced used by a 'Trace' task available again: the
+      /// TraceUnit waits to be plotted in the queue of the worker, or
+      /// if it plotted its own photons, it continues tracing. This
+      /// method is thread-safe.
+      void CompleteTraceTask(const Task completedTask, const int worker);
 
       /// Makes resourced used by a 'Plot' task available again.
       void CompletePlotTask(Task completedTask);
 
+      /// Queues the plot unit for gathering after it plotted something,
+      /// or makes it available again if it plots into the shared film.
+      void CompletePlot(const int plotUnit);
+
       /// Makes resourced used by a 'Gather' task available again.
       void CompleteGatherTask(Task completedTask);
 
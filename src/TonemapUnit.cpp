@@ -17,18 +17,43 @@
 #include "TonemapUnit.h"
 
 #include <cmath>
+#include <fstream>
 #include <numeric>
+#include "EmissiveMaterial.h"
+#include "FastMath.h"
 #include "GatherUnit.h"
 #include "SRgb.h"
+#include "SpectralBands.h"
 
 using namespace Luculentus;
 
-TonemapUnit::TonemapUnit(const int width, const int height)
+TonemapUnit::TonemapUnit(const int width, const int height,
+                         const Settings& settings)
   : imageWidth(width)
   , imageHeight(height)
+  , observer(settings.observer)
 {
   // Allocate a buffer to store the sRGB values
   rgbBuffer.resize(imageWidth * imageHeight * 3, 0);
+
+  // Without white balance, tristimulus values are left as they are
+  const Vector3 ex = { 1.0f, 0.0f, 0.0f };
+  const Vector3 ey = { 0.0f, 1.0f, 0.0f };
+  const Vector3 ez = { 0.0f, 0.0f, 1.0f };
+  Matrix3 identity = { ex, ey, ez };
+  whiteBalance = identity;
+  if (settings.whiteBalance <= 0.0f) return;
+
+  // The white is the colour of a black body at the temperature
+  BlackBodyMaterial body(settings.whiteBalance, 1.0f);
+  Vector3 white = ZeroVector3();
+  for (float wavelength = SpectralBands::minimumWavelength;
+       wavelength < SpectralBands::maximumWavelength; wavelength += 1.0f)
+  {
+    white += SpectralBands::GetTristimulus(observer, wavelength)
+           * body.GetIntensity(wavelength);
+  }
+  whiteBalance = SRgb::GetWhiteBalance(white * (1.0f / white.y));
 }
 
 float clamp(const float x)
@@ -38,16 +63,21 @@ float clamp(const float x)
 
 void TonemapUnit::Tonemap(const GatherUnit& gatherUnit)
 {
-  float maxIntensity = FindExposure(gatherUnit);
+  // Spectra must be converted to tristimulus values first
+  const std::vector<Vector3>& tristimuli = gatherUnit.numberOfBands > 0
+                                         ? ConvertSpectra(gatherUnit)
+                                         : gatherUnit.tristimulusBuffer;
+
+  float maxIntensity = FindExposure(tristimuli);
 
   for (int i = 0; i < imageWidth * imageHeight; i++)
   {
-    Vector3 cie = gatherUnit.tristimulusBuffer[i];
+    Vector3 cie = whiteBalance * tristimuli[i];
 
-    // Apply exposure correction
-    cie.x = std::log(cie.x / maxIntensity + 1.0f) / std::log(4.0f);
-    cie.y = std::log(cie.y / maxIntensity + 1.0f) / std::log(4.0f);
-    cie.z = std::log(cie.z / maxIntensity + 1.0f) / std::log(4.0f);
+    // Apply exposure correction (a base 4 logarithm)
+    cie.x = FastMath::Log2(cie.x / maxIntensity + 1.0f) * 0.5f;
+    cie.y = FastMath::Log2(cie.y / maxIntensity + 1.0f) * 0.5f;
+    cie.z = FastMath::Log2(cie.z / maxIntensity + 1.0f) * 0.5f;
 
     // Convert to sRGB.
     Vector3 rgb = SRgb::Transform(cie);
@@ -64,10 +94,41 @@ void TonemapUnit::Tonemap(const GatherUnit& gatherUnit)
   }
 }
 
-float TonemapUnit::FindExposure(const GatherUnit& gatherUnit) const
+bool TonemapUnit::Save(const std::string& fileName) const
+{
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+
+  // The PPM header, followed by the raw bytes; the format is exactly
+  // the layout of the buffer.
+  file << "P6\n" << imageWidth << " " << imageHeight << "\n255\n";
+  file.write(reinterpret_cast<const char*>(&rgbBuffer[0]),
+             rgbBuffer.size());
+
+  return file.good();
+}
+
+const std::vector<Vector3>& TonemapUnit::ConvertSpectra(
+  const GatherUnit& gatherUnit)
+{
+  const int bands = gatherUnit.numberOfBands;
+  if (static_cast<int>(bandTristimuli.size()) != bands)
+    bandTristimuli = SpectralBands(bands).GetTristimuli(observer);
+
+  tristimulusBuffer.resize(imageWidth * imageHeight);
+  for (int i = 0; i < imageWidth * imageHeight; i++)
+  {
+    const float* spectrum = &gatherUnit.spectralBuffer[i * bands];
+    Vector3 cie = ZeroVector3();
+    for (int b = 0; b < bands; b++) cie += bandTristimuli[b] * spectrum[b];
+    tristimulusBuffer[i] = cie;
+  }
+
+  return tristimulusBuffer;
+}
+
+float TonemapUnit::FindExposure(const std::vector<Vector3>& tristimuli) const
 {
   float n = static_cast<float>(imageWidth * imageHeight);
-  auto& tristimuli = gatherUnit.tristimulusBuffer;
 
   // Calculate the average intensity. Calculations are based
   // on the CIE Y component, which corresponds to lightness.
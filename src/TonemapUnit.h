@@ -17,7 +17,11 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
 #include <vector>
+#include "Matrix3.h"
+#include "Settings.h"
+#include "Vector3.h"
 
 namespace Luculentus
 {
@@ -38,18 +42,42 @@ namespace Luculentus
       std::vector<std::uint8_t> rgbBuffer;
 
       /// Constructs a new tonemap unit that will tonemap a canvas
-      /// of the specified size.
-      TonemapUnit(const int width, const int height);
+      /// of the specified size, for the observer and white balance of
+      /// the settings.
+      TonemapUnit(const int width, const int height,
+                  const Settings& settings);
 
-      /// Converts the unweighted CIE XYZ values in the GatherUnit
-      /// to tonemapped sRGB values.
+      /// Converts the unweighted CIE XYZ values (or spectra) in the
+      /// GatherUnit to tonemapped sRGB values.
       void Tonemap(const GatherUnit& gatherUnit);
 
+      /// Writes the sRGB values to a binary PPM file,
+      /// returns whether that succeeded.
+      bool Save(const std::string& fileName) const;
+
     private:
 
+      /// The observer that spectra are converted for.
+      const Settings::Observer observer;
+
+      /// The tristimulus value of light in every spectral band of the
+      /// spectra that were converted last.
+      std::vector<Vector3> bandTristimuli;
+
+      /// The tristimulus values of the spectra that were converted last.
+      std::vector<Vector3> tristimulusBuffer;
+
+      /// Maps tristimulus values such that the light of the white
+      /// balance appears white (or leaves them as they are).
+      Matrix3 whiteBalance;
+
+      /// Converts the spectra in the gather unit to tristimulus values
+      /// for the observer, and returns them.
+      const std::vector<Vector3>& ConvertSpectra(const GatherUnit& gatherUnit);
+
       /// Returns an exposure estimate based on the average cieY value.
       /// The returned value is the maximum acceptable intensity, the
       /// intensity that should become (nearly) white.
-      float FindExposure(const GatherUnit& gatherUnit) const;
+      float FindExposure(const std::vector<Vector3>& tristimuli) const;
   };
 }
@@ -16,39 +16,300 @@
 
 #include "TraceUnit.h"
 
+#include <algorithm>
+#include <cmath>
+#include "Cie1931.h"
+#include "Constants.h"
+#include "Platform.h"
+#include "PlotUnit.h"
 #include "Scene.h"
+#include "ScreenDistribution.h"
 
 using namespace Luculentus;
 
+const float TraceUnit::maximumSurvivalChance = 0.95f;
+const float TraceUnit::guidedFraction = 0.5f;
+const float TraceUnit::trainingFraction = 0.25f;
+
 TraceUnit::TraceUnit(const Scene& scn,
                      const unsigned long randomSeed, const int width,
-                     const int height)
+                     const int height, const int batchSize,
+                     const Settings& settings, GuidingField* field,
+                     RadianceCache* cache)
   : monteCarloUnit(randomSeed)
   , scene(scn)
   , aspectRatio(static_cast<float>(width) / static_cast<float>(height))
+  , integrator(settings.integrator)
+  , numberOfBufferedPhotons(GetNumberOfBufferedPhotons())
+  , uncountedPaths(ScreenDistribution::GetNumberOfTiles(width, height), 0)
+  , film(nullptr)
+  , packPhotons(settings.packedPhotons && !settings.fusedPlotting)
+  , guidingField(field)
+  , guidingDistribution(nullptr)
+  , numberOfGuidingVertices(0)
+  , radianceCache(cache)
+  , numberOfCacheVertices(0)
+  , maximumSplits(settings.integrator == Settings::PathTracing
+                  ? std::max(1, settings.pathSplits) : 1)
+  , adaptiveSplitting(settings.adaptiveSplitting)
+  , bidirectionalTracer(scn, aspectRatio)
+  , photonMapper(scn)
+  , metropolisSampler(randomSeed + 1)
+  , metropolisNormalisation(0.0f)
+  , isBootstrapped(false)
 {
+  // When plotting is fused with tracing, or photons are packed, only a
+  // few unpacked photons are kept
+  // (the bidirectional integrator produces more photons than paths, so
+  // for it the buffer grows if necessary)
+  if (settings.fusedPlotting || packPhotons)
+    mappedPhotons.reserve(numberOfBufferedPhotons);
+  else
+    mappedPhotons.reserve(batchSize);
+
+  if (packPhotons) packedPhotons.reserve(batchSize);
+
+  // The buffers are filled by the thread that traces, so they end up
+  // close to that thread, but they can be backed by huge pages already
+  AdviseHugePages(mappedPhotons.data(),
+                  mappedPhotons.capacity() * sizeof(MappedPhoton));
+  AdviseHugePages(packedPhotons.data(),
+                  packedPhotons.capacity() * sizeof(PackedPhoton));
+}
 
+int TraceUnit::GetNumberOfBufferedPhotons()
+{
+  return static_cast<int>(std::max<size_t>(1024, std::min<size_t>(65536,
+    GetCacheSize(2) / 2 / sizeof(MappedPhoton))));
 }
 
-void TraceUnit::Render()
+void TraceUnit::Render(const int numberOfPaths,
+                       const ScreenDistribution& screenDistribution,
+                       const GuidingDistribution& guide,
+                       PlotUnit* plotUnit)
 {
-  for (auto& mappedPhoton : mappedPhotons)
+  mappedPhotons.clear();
+  packedPhotons.clear();
+  std::fill(uncountedPaths.begin(), uncountedPaths.end(), 0);
+  film = plotUnit;
+
+  // Only camera paths of the path tracer are guided, the other
+  // integrators sample directions in their own ways
+  guidingDistribution = guidingField && integrator == Settings::PathTracing
+                      ? &guide : nullptr;
+
+  // Metropolis light transport picks screen positions itself
+  if (integrator == Settings::MetropolisLightTransport)
+  {
+    RenderMetropolis(numberOfPaths);
+    FlushPhotons(true);
+    return;
+  }
+
+  // The photon mapper renders a single wavelength every pass, so all
+  // paths can share the same photons
+  const float passWavelength = monteCarloUnit.GetWavelength();
+  if (integrator == Settings::ProgressivePhotonMapping)
+  {
+    photonMapper.TracePhotons(passWavelength, numberOfPaths, monteCarloUnit);
+  }
+
+  for (int i = 0; i < numberOfPaths; i++)
   {
     // Pick a wavelength for this photon
-    const float wavelength = monteCarloUnit.GetWavelength();
-
-    // Pick a screen coordinate for the photon
-    const float x = monteCarloUnit.GetBiUnit();
-    const float y = monteCarloUnit.GetBiUnit() / aspectRatio;
-
-    // Store the pixel coordinates already
-    mappedPhoton.wavelength = wavelength;
-    mappedPhoton.x = x;
-    mappedPhoton.y = y;
-    
-    // And then trace the scene at this wavelength
-    mappedPhoton.probability = RenderCameraRay(x, y, wavelength);
+    const float wavelength = integrator == Settings::ProgressivePhotonMapping
+                           ? passWavelength
+                           : monteCarloUnit.GetWavelength();
+
+    // Pick a screen coordinate for the photon, noisy parts of the
+    // screen are more likely to be picked than converged parts
+    float x, y;
+    const float weight = screenDistribution.Sample(monteCarloUnit, x, y);
+
+    // Trace the scene at this wavelength, compensating for the
+    // probability of picking this position (the bidirectional tracer
+    // also splats photons at other positions)
+    float probability;
+    if (integrator == Settings::BidirectionalPathTracing)
+    {
+      const size_t firstSplat = mappedPhotons.size();
+      probability = bidirectionalTracer.Render(x, y, wavelength, weight,
+                                               screenDistribution,
+                                               monteCarloUnit,
+                                               mappedPhotons);
+
+      // The splats belong to this camera path, they are no samples of
+      // the tiles they land in
+      for (size_t j = firstSplat; j < mappedPhotons.size(); j++)
+      {
+        uncountedPaths[screenDistribution.GetTile(mappedPhotons[j].x,
+                                                  mappedPhotons[j].y)]--;
+      }
+    }
+    else if (integrator == Settings::ProgressivePhotonMapping)
+      probability = weight * photonMapper.Gather(x, y, monteCarloUnit);
+    else
+      probability = weight * RenderCameraRay(x, y, wavelength);
+
+    // Many paths escape without carrying any light, there is no need
+    // to store and plot them, only to count them
+    if (probability > 0.0f)
+    {
+      MappedPhoton mappedPhoton;
+      mappedPhoton.wavelength = wavelength;
+      mappedPhoton.x = x;
+      mappedPhoton.y = y;
+      mappedPhoton.probability = probability;
+      mappedPhotons.push_back(mappedPhoton);
+    }
+    else
+    {
+      uncountedPaths[screenDistribution.GetTile(x, y)]++;
+    }
+
+    FlushPhotons(false);
+  }
+
+  FlushPhotons(true);
+}
+
+void TraceUnit::FlushPhotons(const bool flushAll)
+{
+  // Without a film, the photons are kept for a plot task
+  if (!film)
+  {
+    if (!packPhotons) return;
+    for (auto& photon : mappedPhotons)
+      packedPhotons.push_back(Pack(photon, aspectRatio));
+    mappedPhotons.clear();
+    return;
+  }
+
+  if (!flushAll
+   && static_cast<int>(mappedPhotons.size()) < numberOfBufferedPhotons)
+    return;
+
+  film->Plot(mappedPhotons);
+  mappedPhotons.clear();
+
+  if (flushAll)
+  {
+    film->CountPaths(uncountedPaths);
+    std::fill(uncountedPaths.begin(), uncountedPaths.end(), 0);
+  }
+}
+
+void TraceUnit::RenderMetropolis(const int numberOfPaths)
+{
+  if (!isBootstrapped) Bootstrap();
+
+  // Without any light, there is nothing to explore
+  if (metropolisNormalisation <= 0.0f) return;
+
+  for (int i = 0; i < numberOfPaths; i++)
+  {
+    // Mutate the current path, and render the proposal
+    metropolisSampler.StartIteration(false);
+    MetropolisPath proposal = RenderPrimarySample();
+
+    const float acceptance = metropolisPath.importance > 0.0f
+      ? std::min(1.0f, proposal.importance / metropolisPath.importance)
+      : 1.0f;
+
+    // Both paths contribute, weighted by the probability that the chain
+    // moves to them, which reduces the variance of rejected proposals.
+    // Weight is accumulated while the chain stays at the same path, so
+    // it is splatted only once.
+    metropolisPath.weight += 1.0f - acceptance;
+    proposal.weight = acceptance;
+
+    if (monteCarloUnit.GetUnit() < acceptance)
+    {
+      SplatMetropolisPath(metropolisPath);
+      metropolisPath = proposal;
+      metropolisSampler.Accept();
+    }
+    else
+    {
+      SplatMetropolisPath(proposal);
+      metropolisSampler.Reject();
+    }
+
+    FlushPhotons(false);
+  }
+
+  // The chain continues in the next task, but the weight it gathered in
+  // this one must be splatted now
+  SplatMetropolisPath(metropolisPath);
+  metropolisPath.weight = 0.0f;
+}
+
+void TraceUnit::Bootstrap()
+{
+  double totalImportance = 0.0;
+  MetropolisSampler initialSampler = metropolisSampler;
+  MetropolisPath initialPath = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+  for (int i = 0; i < numberOfBootstrapPaths; i++)
+  {
+    metropolisSampler.StartIteration(true);
+    const MetropolisPath path = RenderPrimarySample();
+    metropolisSampler.Accept();
+
+    // Keep one of the paths, with a probability proportional to its
+    // importance, so the chain starts in its stationary distribution
+    totalImportance += path.importance;
+    if (path.importance > 0.0f
+     && monteCarloUnit.GetUnit() * totalImportance < path.importance)
+    {
+      initialSampler = metropolisSampler;
+      initialPath = path;
+    }
   }
+
+  metropolisNormalisation = static_cast<float>(totalImportance
+                                               / numberOfBootstrapPaths);
+  metropolisSampler = initialSampler;
+  metropolisPath = initialPath;
+  isBootstrapped = true;
+}
+
+TraceUnit::MetropolisPath TraceUnit::RenderPrimarySample()
+{
+  // Take all numbers from the Markov chain, including the ones that
+  // pick the screen position and wavelength
+  monteCarloUnit.metropolisSampler = &metropolisSampler;
+
+  MetropolisPath path;
+  path.x = monteCarloUnit.GetBiUnit();
+  path.y = monteCarloUnit.GetBiUnit() / aspectRatio;
+  path.wavelength = monteCarloUnit.GetWavelength();
+  path.contribution = RenderCameraRay(path.x, path.y, path.wavelength);
+  path.weight = 0.0f;
+
+  monteCarloUnit.metropolisSampler = nullptr;
+
+  // Paths at wavelengths the eye is not sensitive to are not important
+  const Vector3 cie = Cie1931::GetTristimulus(path.wavelength);
+  path.importance = path.contribution * (cie.x + cie.y + cie.z);
+
+  return path;
+}
+
+void TraceUnit::SplatMetropolisPath(const MetropolisPath& path)
+{
+  if (path.weight <= 0.0f || path.importance <= 0.0f) return;
+
+  // The chain visits paths proportional to their importance, so the
+  // contribution must be divided by it. The normalisation restores the
+  // brightness of the image.
+  MappedPhoton mappedPhoton;
+  mappedPhoton.x = path.x;
+  mappedPhoton.y = path.y;
+  mappedPhoton.wavelength = path.wavelength;
+  mappedPhoton.probability = path.weight * metropolisNormalisation
+                           * path.contribution / path.importance;
+  mappedPhotons.push_back(mappedPhoton);
 }
 
 float TraceUnit::RenderCameraRay(const float x, const float y,
@@ -58,7 +319,7 @@ float TraceUnit::RenderCameraRay(const float x, const float y,
   const float t = monteCarloUnit.GetUnit();
 
   // Get the camera at that time
-  const Camera camera = scene.GetCameraAtTime(t);
+  const Camera camera = scene.GetCamera(t);
 
   // Create a camera ray for the specified pixel and wavelength
   Ray ray = camera.GetRay(x, y, wavelength, monteCarloUnit);
@@ -69,54 +330,241 @@ float TraceUnit::RenderCameraRay(const float x, const float y,
 
 float TraceUnit::RenderRay(Ray ray)
 {
-  // The path starts with the ray,
-  // and there is a chance it continues
-  float continueChance = 1.0f;
+  // Light intensity is affected only by interaction probabilities,
+  // and by the weighting of Russian roulette
+  PathState path;
+  path.ray = ray;
+  path.intensity = 1.0f;
+  path.depth = 0;
+  path.diffuseBounces = 0;
+  path.isSplit = false;
 
-  // Apart from the chance, which might decrease even for specular
-  // bounces, light intensity is affected only by interaction
-  // probabilities
-  float intensity = 1.0f;
+  // Forget the vertices of the previous path
+  numberOfGuidingVertices = 0;
+  numberOfCacheVertices = 0;
 
-  do
+  // With the radiance cache, most paths end in the cache after their
+  // first diffuse bounce, and the others are traced in full to train it
+  path.isTraining = radianceCache && integrator == Settings::PathTracing
+                 && monteCarloUnit.GetUnit() < trainingFraction;
+
+  // Intersect the ray with the scene
+  path.object = scene.Intersect(path.ray, path.intersection);
+
+  return TracePath(path);
+}
+
+float TraceUnit::TracePath(PathState path)
+{
+  // Whatever happens along the path, its contribution cannot exceed
+  // its intensity times the intensity of the brightest light
+  const float maximumIntensity =
+    scene.GetMaximumIntensity(path.ray.wavelength);
+  const bool isCached = radianceCache
+                     && integrator == Settings::PathTracing;
+
+  for (;; path.depth++)
   {
-    // Intersect the ray with the scene
-    Intersection intersection;
-    const Object* object = scene.Intersect(ray, intersection);
+    Ray& ray = path.ray;
+    const Intersection& intersection = path.intersection;
+    const Object* object = path.object;
 
     // If nothing was intersected, the path ends,
     // and the only thing left is the utter darkness of The Void
-    if (!object) return 0.0f;
+    if (!object) return EndPath(path.intensity, 0.0f, ray.wavelength);
 
     // If a light was hit, the path ends,
     // and the intensity of the light determines the intensity of the path.
     if (!object->material)
     {
-      return intensity * object->emissiveMaterial->GetIntensity(ray.wavelength);
+      return EndPath(path.intensity,
+                     object->emissiveMaterial->GetIntensity(ray.wavelength),
+                     ray.wavelength);
+    }
+
+    const bool isDiffuse = object->material->IsDiffuse();
+
+    // The camera work is done at the first diffuse surface, so continue
+    // from there in several directions at once
+    if (isDiffuse && path.diffuseBounces == 0 && !path.isSplit
+     && maximumSplits > 1)
+    {
+      return SplitPath(path);
+    }
+
+    if (isCached && isDiffuse)
+    {
+      // The side of the surface that the path arrived at
+      const Vector3 normal = Dot(ray.direction, intersection.normal) < 0.0f
+                           ? intersection.normal : -intersection.normal;
+
+      // After the first diffuse bounce, the cache knows well enough how
+      // much light the surface reflects. The path does not teach the
+      // cache anything then, because it learned nothing new.
+      float radiance;
+      if (!path.isTraining && path.diffuseBounces > 0
+       && radianceCache->Lookup(intersection.position, normal,
+                                ray.wavelength, radiance))
+      {
+        numberOfCacheVertices = 0;
+        return EndPath(path.intensity, radiance, ray.wavelength);
+      }
+
+      // Paths that are traced in full are as good as training paths
+      if (numberOfCacheVertices < maximumRecordedVertices
+       && path.intensity > 0.0f)
+      {
+        CacheVertex& vertex = cacheVertices[numberOfCacheVertices++];
+        vertex.position = intersection.position;
+        vertex.normal = normal;
+        vertex.intensity = path.intensity;
+      }
     }
 
+    if (isDiffuse) path.diffuseBounces++;
+
     // Otherwise, the ray must have hit a non-emissive surface,
     // and so the journey continues ...
-    ray = object->material->GetNewRay(ray, intersection, monteCarloUnit);
-    intensity *= ray.probability;
+    if (guidingDistribution && isDiffuse)
+    {
+      float probability;
+      ray = GetGuidedRay(ray, intersection, *object->material, probability);
+      path.intensity *= ray.probability;
+
+      if (numberOfGuidingVertices < maximumRecordedVertices
+       && path.intensity > 0.0f)
+      {
+        GuidingVertex& vertex = guidingVertices[numberOfGuidingVertices++];
+        vertex.position = intersection.position;
+        vertex.direction = ray.direction;
+        vertex.intensity = path.intensity;
+        vertex.probability = probability;
+      }
+    }
+    else
+    {
+      ray = object->material->GetNewRay(ray, intersection, monteCarloUnit);
+      path.intensity *= ray.probability;
+    }
 
     // Displace the origin slightly, so the new ray won't intersect the
     // same point
     ray.origin = ray.origin + ray.direction * 0.00001f;
 
-    // And the chance of a new bounce decreases slightly
-    continueChance *= 0.96f;
+    // After a few bounces, play Russian roulette: paths that can
+    // contribute only little are likely to end here, and the paths
+    // that survive are weighted to make up for the ones that did not
+    if (path.depth + 1 >= minimumDepth)
+    {
+      const float survivalChance = std::min(maximumSurvivalChance,
+                                            path.intensity * maximumIntensity);
+      if (monteCarloUnit.GetUnit() >= survivalChance)
+      {
+        return EndPath(path.intensity, 0.0f, ray.wavelength);
+      }
+      path.intensity /= survivalChance;
+    }
+
+    // Intersect the new ray with the scene
+    path.object = scene.Intersect(ray, path.intersection);
   }
-  // Use a sharp falloff based on intensity, so an intensity of
-  // 0.1 still has 86% chance of continuing, but an intensity of
-  // 0.01 has only 18% chance of continuing
-  while (monteCarloUnit.GetUnit() * 0.85f < continueChance
-         * (1.0f - std::exp(intensity * -20.0f)));
-
-  // If Russian roulette terminated the path,
-  // there is always an option of trying direct illumination,
-  // which could be implemented here,
-  // but is not
-
-  return 0.0f;
+}
+
+float TraceUnit::SplitPath(PathState path)
+{
+  // Subpaths are worth the effort only when they can carry light: the
+  // dimmer the path, or the darker the surface, the fewer subpaths
+  int splits = maximumSplits;
+  if (adaptiveSplitting)
+  {
+    const float throughput = path.intensity
+      * path.object->material->GetReflectance(path.ray.wavelength);
+    splits = std::max(1, std::min(maximumSplits, static_cast<int>(
+      std::ceil(throughput * maximumSplits))));
+  }
+
+  // Every subpath records its own vertices after the ones they share,
+  // so the guiding field and the radiance cache see independent paths
+  const int sharedGuidingVertices = numberOfGuidingVertices;
+  const int sharedCacheVertices = numberOfCacheVertices;
+
+  path.isSplit = true;
+  float contribution = 0.0f;
+  for (int i = 0; i < splits; i++)
+  {
+    numberOfGuidingVertices = sharedGuidingVertices;
+    numberOfCacheVertices = sharedCacheVertices;
+    contribution += TracePath(path);
+  }
+
+  return contribution / splits;
+}
+
+float TraceUnit::EndPath(const float intensity, const float radiance,
+                         const float wavelength)
+{
+  // The part of the path after a vertex is an estimate of the light
+  // that arrived there from the direction in which the path went
+  for (int i = 0; i < numberOfGuidingVertices; i++)
+  {
+    const GuidingVertex& vertex = guidingVertices[i];
+    guidingField->Record(vertex.position, vertex.direction,
+                         radiance * intensity / vertex.intensity,
+                         vertex.probability);
+  }
+
+  // And it is an estimate of the light that the vertex reflected too;
+  // paths that found no light count as well, or the cache would be
+  // too bright
+  for (int i = 0; i < numberOfCacheVertices; i++)
+  {
+    const CacheVertex& vertex = cacheVertices[i];
+    radianceCache->Record(vertex.position, vertex.normal, wavelength,
+                          radiance * intensity / vertex.intensity);
+  }
+
+  return intensity * radiance;
+}
+
+Ray TraceUnit::GetGuidedRay(const Ray incomingRay,
+                            const Intersection intersection,
+                            const Material& material, float& probability)
+{
+  const int cell = GuidingField::GetCell(intersection.position);
+  const bool isGuided = guidingDistribution->HasLearned(cell);
+
+  // Follow either the learned distribution, or the material
+  Ray ray;
+  if (isGuided && monteCarloUnit.GetUnit() < guidedFraction)
+  {
+    ray.direction = guidingDistribution->Sample(cell, monteCarloUnit);
+    ray.origin = intersection.position;
+    ray.wavelength = incomingRay.wavelength;
+  }
+  else
+  {
+    ray = material.GetNewRay(incomingRay, intersection, monteCarloUnit);
+  }
+
+  // Diffuse materials reflect light only to the side it came from, with
+  // a cosine-weighted distribution
+  const float cosIn = Dot(incomingRay.direction, intersection.normal);
+  const float cosOut = Dot(ray.direction, intersection.normal);
+  const float materialProbability = cosIn * cosOut < 0.0f
+                                  ? std::abs(cosOut) / static_cast<float>(pi)
+                                  : 0.0f;
+
+  // The direction could have been picked either way, so the probability
+  // is that of the mixture
+  probability = isGuided
+    ? (1.0f - guidedFraction) * materialProbability + guidedFraction
+      * guidingDistribution->GetProbability(cell, ray.direction)
+    : materialProbability;
+
+  ray.probability = probability > 0.0f
+    ? material.GetReflectance(incomingRay.wavelength)
+      * materialProbability / probability
+    : 0.0f;
+
+  return ray;
 }
@@ -16,15 +16,24 @@
 
 #pragma once
 
+#include <vector>
+#include "BidirectionalTracer.h"
+#include "GuidingField.h"
 #include "MappedPhoton.h"
+#include "MetropolisSampler.h"
 #include "Ray.h"
 #include "Object.h"
 #include "Intersection.h"
 #include "MonteCarloUnit.h"
+#include "PhotonMapper.h"
+#include "RadianceCache.h"
+#include "Settings.h"
 
 namespace Luculentus
 {
+  class PlotUnit;
   class Scene;
+  class ScreenDistribution;
 
   class TraceUnit
   {
@@ -39,29 +48,241 @@ namespace Luculentus
       /// The aspect ratio of the image that will be rendered
       const float aspectRatio;
 
-      // Trace less paths per task in debug mode, because debug mode is
-      // terribly slow
+      /// The algorithm used to render the photons
+      const Settings::Integrator integrator;
+
+      /// The largest number of paths per task, unless the batch size is
+      /// set explicitly. Trace less paths per task in debug mode,
+      /// because debug mode is terribly slow.
       #ifdef _DEBUG
-      static const int numberOfPaths = 1024 * 64;
+      static const int defaultBatchSize = 1024 * 64;
       #else
-      static const int numberOfPaths = 1024 * 512;
+      static const int defaultBatchSize = 1024 * 512;
       #endif
 
-      static const int numberOfMappedPhotons = numberOfPaths;
+      /// The number of photons that is buffered before they are plotted,
+      /// when plotting is fused with tracing. Small enough for the
+      /// buffer to stay in the level 2 cache.
+      const int numberOfBufferedPhotons;
+
+      /// Returns the number of buffered photons that fits in the level 2
+      /// cache, within sensible bounds.
+      static int GetNumberOfBufferedPhotons();
+
+      /// The number of bounces before Russian roulette may end a path.
+      static const int minimumDepth = 3;
+
+      /// The highest chance with which Russian roulette lets a path
+      /// continue. Must be less than one, so that paths trapped between
+      /// specular surfaces end eventually.
+      static const float maximumSurvivalChance;
+
+      /// The number of independent paths traced to estimate the
+      /// brightness of the image, before the Markov chain starts.
+      static const int numberOfBootstrapPaths = defaultBatchSize / 4;
+
+      /// The fraction of diffuse bounces that follows the learned
+      /// distribution of incident light, when path guiding is enabled.
+      static const float guidedFraction;
+
+      /// The fraction of paths that is traced in full to train the
+      /// radiance cache, when the cache is enabled.
+      static const float trainingFraction;
 
-      /// The photons that were rendered
-      MappedPhoton mappedPhotons[numberOfMappedPhotons];
+      /// The number of diffuse vertices per path that the guiding field
+      /// and the radiance cache learn from.
+      static const int maximumRecordedVertices = 16;
+
+      /// The photons that were rendered. Paths that carried no light
+      /// are left out. When photons are packed, this only holds the
+      /// photons of the current path.
+      std::vector<MappedPhoton> mappedPhotons;
+
+      /// The photons that were rendered, if photons are packed.
+      std::vector<PackedPhoton> packedPhotons;
+
+      /// The tile statistics count camera paths, but they see photons.
+      /// For every tile, this holds the number of paths that carried no
+      /// light, which are not stored as photons, minus the number of
+      /// photons that the bidirectional tracer splatted besides the
+      /// photon of the camera path.
+      std::vector<int> uncountedPaths;
 
       /// Creates a new work unit that renders the specified scene,
-      /// initialized with the specified random seed
+      /// initialized with the specified random seed, with room for the
+      /// photons of the specified number of paths.
       TraceUnit(const Scene& scn, const unsigned long randomSeed,
-                const int width, const int height);
+                const int width, const int height, const int batchSize,
+                const Settings& settings, GuidingField* field,
+                RadianceCache* cache);
 
-      /// Fills the buffer of mapped photons once.
-      void Render();
+      /// Fills the buffer of mapped photons with the specified number of
+      /// paths, picking screen positions with the specified
+      /// distribution, and guiding diffuse bounces with the guiding
+      /// distribution. If a plot unit is specified, photons are plotted
+      /// into it as they are traced, and the buffer is empty afterwards.
+      void Render(const int numberOfPaths,
+                  const ScreenDistribution& screenDistribution,
+                  const GuidingDistribution& guide, PlotUnit* plotUnit);
 
     private:
 
+      /// The plot unit that photons are plotted into during the current
+      /// task, or null if they are kept in the buffer (not owned).
+      PlotUnit* film;
+
+      /// Whether photons are packed (only when they are not plotted
+      /// while tracing).
+      bool packPhotons;
+
+      /// Plots the buffered photons into the film once there are enough
+      /// of them, or all of them if flushAll is true. Without a film,
+      /// packs the photons if packing is enabled.
+      void FlushPhotons(const bool flushAll);
+
+      /// The field that completed paths are recorded into, or null if
+      /// path guiding is disabled (not owned).
+      GuidingField* guidingField;
+
+      /// The distribution that guides the paths of the current task,
+      /// or null if the paths are not guided.
+      const GuidingDistribution* guidingDistribution;
+
+      /// A diffuse vertex of a path, that the guiding field learns from
+      /// once the path is complete.
+      struct GuidingVertex
+      {
+        /// The position of the vertex.
+        Vector3 position;
+
+        /// The direction in which the path continued.
+        Vector3 direction;
+
+        /// The intensity of the path after scattering at the vertex.
+        float intensity;
+
+        /// The probability density of the direction.
+        float probability;
+      };
+
+      /// The guided vertices of the current path.
+      GuidingVertex guidingVertices[maximumRecordedVertices];
+
+      /// The number of guided vertices of the current path.
+      int numberOfGuidingVertices;
+
+      /// The cache that diffuse bounces end in, or null if the radiance
+      /// cache is disabled (not owned).
+      RadianceCache* radianceCache;
+
+      /// A diffuse vertex of a path, of which the radiance cache learns
+      /// the reflected light once the path is complete.
+      struct CacheVertex
+      {
+        /// The position of the vertex.
+        Vector3 position;
+
+        /// The normal of the surface, on the side the path arrived from.
+        Vector3 normal;
+
+        /// The intensity of the path before scattering at the vertex.
+        float intensity;
+      };
+
+      /// The diffuse vertices of the current path.
+      CacheVertex cacheVertices[maximumRecordedVertices];
+
+      /// The number of diffuse vertices of the current path.
+      int numberOfCacheVertices;
+
+      /// The number of subpaths that continue a path from its first
+      /// diffuse surface (one means no splitting).
+      int maximumSplits;
+
+      /// Whether paths that carry little light are split into fewer
+      /// subpaths.
+      bool adaptiveSplitting;
+
+      /// The state of a path at the surface it arrived at.
+      struct PathState
+      {
+        /// The ray that arrived at the surface.
+        Ray ray;
+
+        /// The intersection of the ray with the surface.
+        Intersection intersection;
+
+        /// The object that was hit, or null if the ray left the scene.
+        const Object* object;
+
+        /// The intensity of the path when it arrived.
+        float intensity;
+
+        /// The number of bounces before the surface.
+        int depth;
+
+        /// The number of diffuse surfaces before this one.
+        int diffuseBounces;
+
+        /// Whether the path must not end in the radiance cache.
+        bool isTraining;
+
+        /// Whether the path was already split.
+        bool isSplit;
+      };
+
+      /// The integrator used for bidirectional path tracing.
+      BidirectionalTracer bidirectionalTracer;
+
+      /// The integrator used for progressive photon mapping.
+      PhotonMapper photonMapper;
+
+      /// A path rendered from a primary sample vector.
+      struct MetropolisPath
+      {
+        /// Screen position and wavelength of the path.
+        float x, y, wavelength;
+
+        /// The contribution of the path (as returned by RenderRay).
+        float contribution;
+
+        /// The value the Markov chain samples proportionally to: the
+        /// contribution, weighted by the response of the eye.
+        float importance;
+
+        /// The accumulated weight with which the path must be splatted.
+        float weight;
+      };
+
+      /// The Markov chain of Metropolis light transport.
+      MetropolisSampler metropolisSampler;
+
+      /// The path at the current state of the chain.
+      MetropolisPath metropolisPath;
+
+      /// The average importance of all paths, as estimated by the
+      /// bootstrap paths. Zero before the bootstrap.
+      float metropolisNormalisation;
+
+      /// Whether the bootstrap paths have been traced.
+      bool isBootstrapped;
+
+      /// Fills the buffer of mapped photons by advancing the Markov
+      /// chain of Metropolis light transport by the specified number
+      /// of iterations.
+      void RenderMetropolis(const int numberOfPaths);
+
+      /// Estimates the normalisation, and picks the initial state of the
+      /// Markov chain proportional to importance.
+      void Bootstrap();
+
+      /// Renders a path with the numbers of the current proposal of the
+      /// Markov chain.
+      MetropolisPath RenderPrimarySample();
+
+      /// Adds a photon for the path, with its accumulated weight.
+      void SplatMetropolisPath(const MetropolisPath& path);
+
       /// Returns the contribution of a ray through the specified screen
       /// coordinates.
       float RenderCameraRay(const float x, const float y,
@@ -70,5 +291,25 @@ namespace Luculentus
       /// Retruns the contribution of a photon travelling backwards the
       /// specified ray.
       float RenderRay(Ray ray);
+
+      /// Continues the path until it ends, and returns its contribution.
+      float TracePath(PathState path);
+
+      /// Continues the path from its first diffuse surface in several
+      /// directions, and returns the average contribution.
+      float SplitPath(PathState path);
+
+      /// Lets the guiding field and the radiance cache learn from the
+      /// current path, which found the specified radiance at the end, and
+      /// returns the contribution of the path.
+      float EndPath(const float intensity, const float radiance,
+                    const float wavelength);
+
+      /// Returns the ray that continues the path at a diffuse surface,
+      /// picked with a mixture of the material and the guiding
+      /// distribution, and sets the probability density of its
+      /// direction.
+      Ray GetGuidedRay(const Ray incomingRay, const Intersection intersection,
+                       const Material& material, float& probability);
   };
 }
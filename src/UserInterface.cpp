@@ -38,6 +38,9 @@ UserInterface::UserInterface(int argc, char** argv) :
 
   // If the dispatcher is invoked, display the new image
   dispatcher.connect([this]() { this->DisplayImage(); });
+
+  // Hiding the main window ends the main loop
+  closeDispatcher.connect([this]() { this->window.hide(); });
 }
 
 void UserInterface::DisplayImage(int width, int height,
@@ -57,6 +60,11 @@ void UserInterface::DisplayImage(int width, int height,
   dispatcher();
 }
 
+void UserInterface::Close()
+{
+  closeDispatcher();
+}
+
 void UserInterface::DisplayImage()
 {
   resultImage.set(resultImageBuffer);
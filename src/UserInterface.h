@@ -36,6 +36,10 @@ namespace Luculentus
       void DisplayImage(int width, int height,
                         const std::vector<std::uint8_t>& data);
 
+      /// Closes the window, which makes Run return.
+      /// Can be called from any thread.
+      void Close();
+
     private:
 
       /// The main GTK object
@@ -56,6 +60,9 @@ namespace Luculentus
       /// A dispatcher to keep the UI on one thread
       Glib::Dispatcher dispatcher;
 
+      /// A dispatcher to close the window from another thread
+      Glib::Dispatcher closeDispatcher;
+
       /// Displays the image stored in resultImageBuffer in the UI
       void DisplayImage();
   };